@@ -0,0 +1,600 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2024, John Burnell
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  CrabBench.cpp
+  Timings of the history and completion, and a stress test of appending
+-----------------------------------------------------------------------------*/
+
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include <filesystem>
+namespace fs = std::filesystem;
+
+#include "History.h"
+#include "HistoryCompact.h"
+#include "HistoryFuzzy.h"
+#include "HistoryHint.h"
+#include "HistoryNext.h"
+#include "HistoryShard.h"
+#include "HistoryText.h"
+#include "HistoryTrigram.h"
+#include "HistoryWriter.h"
+#include "Utilities.h"
+#include "PathIndex.h"
+
+
+void BenchFolderItems()
+{
+    // cost of getting and scanning a folder's history as it grows
+    std::cout << "Folder size   GetFolderItems ns   newest-first scan ns\n";
+    for (int size : {100, 1000, 10000, 100000}) {
+        ShellHistoryClass history;
+        for (int i = 0; i < size; i++) {
+            history.Append("make target" + std::to_string(i), "/home/user/project", i, false);
+        }
+
+        const int noCalls = 1000;
+        size_t total = 0;
+        auto t0 = std::chrono::steady_clock::now();
+        for (int i = 0; i < noCalls; i++) {
+            total += history.GetFolderItems("/home/user/project").Size();
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        for (int i = 0; i < noCalls; i++) {
+            HistoryView view = history.GetFolderItems("/home/user/project");
+            for (auto it = view.rbegin(); it != view.rend(); it++) {
+                total += it->cmd.size();
+            }
+        }
+        auto t2 = std::chrono::steady_clock::now();
+
+        std::cout << size << "\t" << std::chrono::duration<double, std::nano>(t1-t0).count() / noCalls
+                  << "\t" << std::chrono::duration<double, std::nano>(t2-t1).count() / noCalls 
+                  << "\t(" << total << ")\n";
+    }
+}
+
+
+void BenchMemory()
+{
+    // store size for a history of 100k commands spread over 200 folders
+    const int size = 100000;
+    ShellHistoryClass history;
+    for (int i = 0; i < size; i++) {
+        history.Append("git commit -m \"change number " + std::to_string(i) + "\"",
+                       "/home/user/projects/project" + std::to_string(i % 200), i, false);
+    }
+    std::cout << "Store for " << size << " entries: " << history.MemoryUsage() << " bytes, "
+              << history.MemoryUsage() / size << " bytes per entry\n";
+}
+
+
+void BenchHints()
+{
+    // frecency ranking: a command used many times beats a recent typo, and the
+    // lookup cost does not grow with the history
+    const int64_t day = 24*3600;
+    const int64_t now = 1750000000;
+    ShellHistoryClass history;
+    for (int i = 0; i < 50; i++) {
+        history.Append("make -j8 install", "/home/user/project", now - day + i*60, false);
+    }
+    history.Append("make -j8 isntall", "/home/user/project", now - 300, false, false);
+    history.Append("make clean", "/home/user/other", now - 60, false);
+
+    std::string hint;
+    for (std::string pref : {"make", "make -j8 i"}) {
+        history.GetHint(pref, "/home/user/project", hint);
+        std::cout << "Hint for '" << pref << "' in project: " << hint << "\n";
+        history.GetHint(pref, "/home/user/other", hint);
+        std::cout << "Hint for '" << pref << "' in other: " << hint << "\n";
+    }
+    std::cout << "Frecency of make -j8 install " << history.GetFrecency("make -j8 install", "", now)
+              << ", of the typo " << history.GetFrecency("make -j8 isntall", "", now) << "\n";
+    history.GetHint("make", "/home/user/project/src/lib", hint);
+    std::cout << "Hint for 'make' in project/src/lib: " << hint << "\n";
+
+    // folders above are found by path, the cost is by depth not the number of folders
+    std::cout << "Folders   GetHint ns from 3 levels down\n";
+    for (int noFolders : {10, 1000, 100000}) {
+        ShellHistoryClass many;
+        for (int i = 0; i < 200000; i++) {
+            many.Append("cmake --build build" + std::to_string(i % 100), 
+                        "/home/user/projects/project" + std::to_string(i % noFolders), now - 200000 + i, false);
+        }
+        const int noCalls = 100000;
+        size_t total = 0;
+        auto t0 = std::chrono::steady_clock::now();
+        for (int i = 0; i < noCalls; i++) {
+            many.GetHint("cmake --build build4", "/home/user/projects/project7/src/lib/detail", hint);
+            total += hint.size();
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        std::cout << noFolders << "\t" << std::chrono::duration<double, std::nano>(t1-t0).count() / noCalls
+                  << "\t(" << total << ")\n";
+    }
+
+    std::cout << "History size   GetHint ns\n";
+    for (int size : {1000, 10000, 100000, 1000000}) {
+        ShellHistoryClass big;
+        for (int i = 0; i < size; i++) {
+            big.Append("git commit -m \"change number " + std::to_string(i % 5000) + "\"",
+                       "/home/user/projects/project" + std::to_string(i % 200), now - size + i, false);
+        }
+        const int noCalls = 100000;
+        size_t total = 0;
+        auto t0 = std::chrono::steady_clock::now();
+        for (int i = 0; i < noCalls; i++) {
+            big.GetHint("git commit -m \"change number 4", "/home/user/projects/project7", hint);
+            total += hint.size();
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        std::cout << size << "\t" << std::chrono::duration<double, std::nano>(t1-t0).count() / noCalls
+                  << "\t(" << total << ")\n";
+    }
+}
+
+
+void BenchHintThread()
+{
+    // The hint thread looks up each key while the shell goes on adding
+    // commands, neither waits for the other. Shows the time a key waits for
+    // its hint with a 2ms budget and checks the hints against looking them up
+    // once the adding has finished
+    const int64_t now = 1750000000;
+    ShellHistoryClass history;
+    for (int i = 0; i < 1000000; i++) {
+        history.Append("git commit -m \"change number " + std::to_string(i % 5000) + "\"",
+                       "/home/user/projects/project" + std::to_string(i % 200), now + i, false);
+    }
+    HistoryHintClass worker;
+    worker.Start();
+
+    const std::string typed = "git commit -m \"change number 4321\"";
+    const std::string folder = "/home/user/projects/project1/src";
+    int noKeys = 0, noHints = 0, noWrong = 0, n = 0;
+    double maxMS = 0.0;
+    for (int rep = 0; rep < 20; rep++) {
+        for (size_t len = 1; len <= typed.size(); len++) {
+            auto t0 = std::chrono::steady_clock::now();
+            std::vector<HistoryFolderTreeClass::Ancestor> folders;
+            history.FindFolders(folder, folders);
+            uint64_t gen = worker.Request(typed.substr(0, len), history.GetIndex(), folders, folder);
+            auto t1 = std::chrono::steady_clock::now();
+            // commands added while the hint is found, none start with git
+            for (int i = 0; i < 2000; i++, n++) {
+                history.Append("make target" + std::to_string(n % 1000), "/home/user/build" + std::to_string(n % 50),
+                               now + 2000000 + n, false);
+            }
+            bool found = false;
+            std::string hint, expected;
+            auto t2 = std::chrono::steady_clock::now();
+            bool done = worker.Wait(gen, 2, found, hint);
+            auto t3 = std::chrono::steady_clock::now();
+            if (done and found) {
+                noHints++;
+                history.GetHint(typed.substr(0, len), folder, expected);
+                noWrong += hint != expected;
+            }
+            maxMS = std::max(maxMS, std::chrono::duration<double, std::milli>((t1-t0) + (t3-t2)).count());
+            noKeys++;
+        }
+    }
+    std::cout << noKeys << " keys with " << n << " commands added, " << noHints << " hints in time, " 
+              << noWrong << " different, longest key " << maxMS << " ms\n";
+}
+
+
+void BenchFuzzy(const int size)
+{
+    // interactive fuzzy search, each query extends the one before as when typing
+    const char *words[] = {"git", "commit", "checkout", "push", "status", "make", "build", "clean", "cmake",
+                           "docker", "run", "ssh", "grep", "-rn", "ls", "-la", "cd", "src", "include",
+                           "python3", "manage.py", "test", "vim", "CrabShell.cpp", "History.h", "origin",
+                           "main", "feature/fuzzySearch", "--target", "install", "kubectl", "get", "pods"};
+    const int noWords = sizeof(words) / sizeof(words[0]);
+    HistoryFuzzyClass fuzzy;
+    uint32_t seed = 1;
+    for (int i = 0; i < size; i++) {
+        std::string cmd;
+        int len = 2 + i % 5;
+        for (int w = 0; w < len; w++) {
+            seed = seed * 1103515245 + 12345;
+            cmd += std::string(w > 0 ? " " : "") + words[(seed >> 16) % noWords];
+        }
+        cmd += " " + std::to_string(i % 9973);
+        fuzzy.Add(cmd, i);
+    }
+
+    for (std::string query : {"gcm", "mkbld", "dkrrun", "CrabSh", "xyzzy"}) {
+        std::vector<HistoryFuzzyClass::Match> res;
+        std::cout << query << ":";
+        for (size_t n = 1; n <= query.size(); n++) {
+            auto t0 = std::chrono::steady_clock::now();
+            fuzzy.Search(query.substr(0, n), 12, res);
+            auto t1 = std::chrono::steady_clock::now();
+            std::cout << " " << std::chrono::duration<double, std::milli>(t1-t0).count() << "ms";
+        }
+        std::cout << " (" << res.size() << " shown)\n";
+    }
+}
+
+
+void BenchSubstring(const std::string &file, const std::string &text)
+{
+    // substring search with the trigram index against looking through every record
+    HistoryFileClass hist;
+    std::vector<HistoryFileClass::Record> recs;
+    if (!hist.Open(file) or !hist.GetRecords(recs)) {
+        return;
+    }
+    std::string folded = Utilities::ToLower(text);
+    auto t0 = std::chrono::steady_clock::now();
+    std::unordered_set<std::string_view> seen;
+    for (auto it = recs.rbegin(); it != recs.rend() and seen.size() < 20; it++) {
+        if (Utilities::ToLower(std::string(it->cmd)).find(folded) != std::string::npos) {
+            seen.insert(it->cmd);
+        }
+    }
+    auto t1 = std::chrono::steady_clock::now();
+
+    HistoryTrigramClass index;
+    for (int i = 0; i < 100000 and !index.Update(file); i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    auto t2 = std::chrono::steady_clock::now();
+    std::vector<std::string> res;
+    index.Search(text, 20, res);
+    auto t3 = std::chrono::steady_clock::now();
+
+    std::cout << recs.size() << " records, scan found " << seen.size() << " in " 
+              << std::chrono::duration<double, std::milli>(t1-t0).count() << " ms\n";
+    std::cout << "index of " << index.Size() << " records read or updated in "
+              << std::chrono::duration<double, std::milli>(t2-t1).count() << " ms, found " << res.size() << " in "
+              << std::chrono::duration<double, std::milli>(t3-t2).count() << " ms\n";
+}
+
+
+void BenchNext(const std::string &file, const std::string &line)
+{
+    // building or catching up the next token table, then predicting from it
+    HistoryNextClass next;
+    auto t0 = std::chrono::steady_clock::now();
+    next.Update(file);
+    auto tu = std::chrono::steady_clock::now();
+    while (next.Building()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    next.Update(file);
+    auto t1 = std::chrono::steady_clock::now();
+    std::vector<std::string> res;
+    size_t start = 0;
+    const int noCalls = 10000;
+    for (int i = 0; i < noCalls; i++) {
+        next.Predict(line, Utilities::GetCurrentDirectory(), 8, res, start);
+    }
+    auto t2 = std::chrono::steady_clock::now();
+
+    std::cout << "table of " << next.NoContexts() << " contexts read or updated in "
+              << std::chrono::duration<double, std::milli>(t1-t0).count() << " ms ("
+              << std::chrono::duration<double, std::milli>(tu-t0).count() << " ms before the thread), predict "
+              << std::chrono::duration<double, std::micro>(t2-t1).count() / noCalls << " us\n";
+    for (const auto &tok : res) {
+        std::cout << "  " << line.substr(0, start) << tok << "\n";
+    }
+}
+
+
+size_t ParseTextGetline(const std::string &textFile)
+{
+    // the original line by line reader, for comparison
+    std::ifstream inp(textFile);
+    for (std::string line; std::getline(inp, line);) {
+        Utilities::StripStringEnd(line);
+        if (line == "History:") {
+            break;
+        }
+    }
+    std::vector<std::string> cmds;
+    std::string keys[] = {"- Cmd: ", "Date: ", "Folder: "};
+    std::string fields[3];
+    std::string line;
+    bool more = true;
+    while (more and std::getline(inp, line)) {
+        Utilities::StripStringEnd(line);
+        if (line.find(keys[0]) != line.npos) {
+            for (int i = 0; i < 3; i++) {
+                size_t pos = line.find(keys[i]);
+                if (pos != line.npos) {
+                    std::string st = line.substr(pos+keys[i].size());
+                    if (st.find("'") == 0) {
+                        st.erase(0, 1);
+                        size_t pos1 = st.find("'");
+                        if (pos1 != st.npos) {
+                            st.erase(pos1, 1);
+                        }
+                    }
+                    fields[i] = st;
+                }
+                if (i < 2 and !std::getline(inp, line)) {
+                    more = false;
+                    break;
+                }
+            }
+            if (more) {
+                Utilities::ParseTime(fields[1]);
+                cmds.push_back(fields[0]);
+            }
+        }
+    }
+    return cmds.size();
+}
+
+
+void BenchTextParse(const int size)
+{
+    // parse rate of the yaml history, one new second per entry
+    fs::path textFile = fs::temp_directory_path() / "crabshell_bench_history.dat";
+    {
+        std::ofstream ofs(textFile);
+        ofs << "History:\n";
+        for (int i = 0; i < size; i++) {
+            ofs << "- Cmd: git commit -m \"change number " << i << "\"\n";
+            ofs << "  Date: '" << Utilities::FormatTime(1700000000 + i) << "'\n";
+            ofs << "  Folder: /home/user/projects/project" << i % 200 << "\n";
+        }
+    }
+    double mb = fs::file_size(textFile) / (1024.0*1024.0);
+
+    auto t0 = std::chrono::steady_clock::now();
+    size_t noLines = ParseTextGetline(textFile.string());
+    auto t1 = std::chrono::steady_clock::now();
+    std::vector<HistoryFileClass::Record> recs;
+    {
+        Utilities::MappedFile text;
+        text.Open(textFile.string());
+        HistoryTextParserClass parser;
+        parser.Parse(text.Data(), text.Size(), recs);
+    }
+    auto t2 = std::chrono::steady_clock::now();
+
+    double getlineSec = std::chrono::duration<double>(t1-t0).count();
+    double parseSec = std::chrono::duration<double>(t2-t1).count();
+    std::cout << "Text history of " << size << " entries, " << mb << " MB\n";
+    std::cout << "getline parser " << noLines << " entries " << mb / getlineSec << " MB/s\n";
+    std::cout << "stream parser  " << recs.size() << " entries " << mb / parseSec << " MB/s\n";
+    fs::remove(textFile);
+}
+
+
+void BenchLoad(const std::string &file)
+{
+    // load time of an existing history as threads are added
+    unsigned int maxThreads = std::max(1U, std::thread::hardware_concurrency());
+    for (unsigned int noThreads = 1; noThreads <= maxThreads; noThreads *= 2) {
+        ShellHistoryClass history;
+        history.SetLoadThreads(noThreads);
+        auto t0 = std::chrono::steady_clock::now();
+        history.Load(file);
+        auto t1 = std::chrono::steady_clock::now();
+        std::cout << noThreads << " threads: " << history.GetNoHistory() << " items in " 
+                  << std::chrono::duration<double, std::milli>(t1-t0).count() << " ms\n";
+    }
+
+    // only the newest commands
+    ShellHistoryClass history;
+    history.SetWindow(10000, 200, 0);
+    auto t0 = std::chrono::steady_clock::now();
+    history.Load(file);
+    auto t1 = std::chrono::steady_clock::now();
+    std::cout << "10000 newest: " << history.GetNoHistory() << " items in " 
+              << std::chrono::duration<double, std::milli>(t1-t0).count() << " ms\n";
+
+    // then going to the folder of the oldest record, its records are found
+    // by scanning or from its shard
+    HistoryFileClass hist;
+    HistoryFileClass::Record rec;
+    if (!hist.Open(file) or !hist.DecodeIndexed(0, rec)) {
+        return;
+    }
+    std::string folder(rec.folder);
+    HistoryShardClass shards;
+    shards.Update(file, hist, 256);
+    while (shards.Building()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    for (size_t noShards : {0, 256}) {
+        ShellHistoryClass windowed;
+        windowed.SetWindow(10000, 200, 0);
+        windowed.SetShards(noShards);
+        auto t2 = std::chrono::steady_clock::now();
+        windowed.Load(file);
+        auto t3 = std::chrono::steady_clock::now();
+        windowed.UseFolder(folder);
+        auto t4 = std::chrono::steady_clock::now();
+        std::cout << noShards << " shards: loaded in " << std::chrono::duration<double, std::milli>(t3-t2).count()
+                  << " ms, " << windowed.GetFolderItems(folder).Size() << " items of " << folder << " in "
+                  << std::chrono::duration<double, std::milli>(t4-t3).count() << " ms\n";
+    }
+}
+
+
+bool StressAppend(const std::string &file, const int noWriters, const int noCmds, const std::string &dur)
+{
+    // many shells appending to one history file at once, nothing should be lost
+    std::error_code ec;
+    fs::remove(file, ec);
+    {
+        ShellHistoryClass history;
+        history.Load(file);
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<std::thread> writers;
+    for (int w = 0; w < noWriters; w++) {
+        writers.emplace_back([file, w, noCmds, dur]() {
+            ShellHistoryClass history;
+            history.Load(file);
+            if (dur.size() > 0) {
+                history.StartWriter(HistoryWriterClass::ParseDurability(dur), 1000, 64);
+            }
+            for (int i = 0; i < noCmds; i++) {
+                history.Append("writer " + std::to_string(w) + " command " + std::to_string(i), 
+                               "/stress/" + std::to_string(w), i, true);
+            }
+        });
+    }
+    for (auto &t : writers) {
+        t.join();
+    }
+    auto t1 = std::chrono::steady_clock::now();
+
+    ShellHistoryClass history;
+    history.Load(file);
+    int expected = noWriters*noCmds;
+    std::cout << noWriters << " writers appended " << history.GetNoHistory() << " of " << expected 
+              << " commands in " << std::chrono::duration<double, std::milli>(t1-t0).count() << " ms\n";
+    return int(history.GetNoHistory()) == expected;
+}
+
+
+void BenchComplete(const std::string &folder, const std::string &pref)
+{
+    // walking a folder with a stat per entry against scanning it, completing
+    // in it against its cached listing, and the listing being dropped when a
+    // file is added
+    std::string line = "ls " + folder + "/" + pref;
+    size_t noWalked = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (const auto &ent : fs::directory_iterator{folder}) {
+        bool isDir = fs::is_directory(ent.path());
+        noWalked += isDir and Utilities::StartsWith(ent.path().filename().string(), pref, false);
+    }
+    auto ts = std::chrono::steady_clock::now();
+    size_t noScanned = 0;
+    Utilities::ScanFolder(folder, [&](const std::string_view &name, const bool isDir) {
+        noScanned += isDir and Utilities::StartsWith(std::string(name), pref, false);
+        return true;
+    });
+    auto t1 = std::chrono::steady_clock::now();
+    std::vector<CompletionItem> matches;
+    int startPos;
+    Utilities::GetFileMatches(line, matches, startPos);
+    auto t2 = std::chrono::steady_clock::now();
+    const int noCalls = 100;
+    for (int i = 0; i < noCalls; i++) {
+        Utilities::GetFileMatches(line, matches, startPos);
+    }
+    auto t3 = std::chrono::steady_clock::now();
+    std::cout << "walk with a stat each " << std::chrono::duration<double, std::milli>(ts-t0).count() << " ms, scan "
+                        << std::chrono::duration<double, std::milli>(t1-ts).count() << " ms, " << noWalked << " = " << noScanned
+                        << " folders\n";
+    std::cout << "first completion "
+                        << std::chrono::duration<double, std::milli>(t2-t1).count() << " ms, cached "
+                        << std::chrono::duration<double, std::milli>(t3-t2).count() / noCalls << " ms, "
+                        << matches.size() << " matches\n";
+
+    // the first page of matches, as Tab shows them
+    const size_t pageSize = 1000;
+    size_t noPaged = 0;
+    auto t4 = std::chrono::steady_clock::now();
+    Utilities::GetCompletions(line, [&noPaged](CompletionItem &&) {
+        return ++noPaged < pageSize;
+    }, startPos);
+    auto t5 = std::chrono::steady_clock::now();
+    std::cout << "first " << noPaged << " matches "
+                        << std::chrono::duration<double, std::milli>(t5-t4).count() << " ms\n";
+
+    fs::path added = fs::path(folder) / (pref + "_crabshell_bench_file");
+    std::ofstream(added.string()).close();
+    Utilities::GetFileMatches(line, matches, startPos);
+    size_t withFile = matches.size();
+    fs::remove(added);
+    Utilities::GetFileMatches(line, matches, startPos);
+    std::cout << "after adding a file " << withFile << " matches, after removing it " << matches.size() << "\n";
+}
+
+
+void BenchPath(const std::string &pref)
+{
+    // building the PATH command names, building them again with no folder
+    // changed, and completing a command name from them
+    auto t0 = std::chrono::steady_clock::now();
+    PathIndexClass::Get().Refresh();
+    auto t1 = std::chrono::steady_clock::now();
+    PathIndexClass::Get().Refresh();
+    auto t2 = std::chrono::steady_clock::now();
+    const int noCalls = 1000;
+    size_t noFound = 0;
+    for (int i = 0; i < noCalls; i++) {
+        noFound = 0;
+        PathIndexClass::Get().Find(pref, [&noFound](const std::string &) {
+            noFound++;
+            return true;
+        });
+    }
+    auto t3 = std::chrono::steady_clock::now();
+    std::cout << PathIndexClass::Get().Size() << " commands built in "
+                        << std::chrono::duration<double, std::milli>(t1-t0).count() << " ms, again in "
+                        << std::chrono::duration<double, std::milli>(t2-t1).count() << " ms, "
+                        << noFound << " starting with " << pref << " found in "
+                        << std::chrono::duration<double, std::micro>(t3-t2).count() / noCalls << " us\n";
+}
+
+int main(int argc, char const *argv[])
+{
+    if (argc < 2) {
+        std::cout << "Usage: CrabBench -bench\n";
+        std::cout << "       CrabBench -benchtext [entries]\n";
+        std::cout << "       CrabBench -benchload history_file\n";
+        std::cout << "       CrabBench -benchfuzzy [entries]\n";
+        std::cout << "       CrabBench -benchsearch history_file text\n";
+        std::cout << "       CrabBench -benchnext history_file line\n";
+        std::cout << "       CrabBench -benchcomplete folder prefix\n";
+        std::cout << "       CrabBench -benchpath prefix\n";
+        std::cout << "       CrabBench -stress history_file [writers] [commands] [none|flush|fsync]\n";
+        return 0;
+    }
+    std::string opt = argv[1];
+
+    if (opt == "-stress" and argc > 2) {
+        int noWriters = argc > 3 ? std::stoi(argv[3]) : 16;
+        int noCmds = argc > 4 ? std::stoi(argv[4]) : 500;
+        std::string dur = argc > 5 ? argv[5] : "";
+        return StressAppend(argv[2], noWriters, noCmds, dur) ? 0 : 1;
+    }
+    if (opt == "-benchload" and argc > 2) {
+        BenchLoad(argv[2]);
+    } else if (opt == "-benchsearch" and argc > 3) {
+        BenchSubstring(argv[2], argv[3]);
+    } else if (opt == "-benchnext" and argc > 3) {
+        BenchNext(argv[2], argv[3]);
+    } else if (opt == "-benchfuzzy") {
+        BenchFuzzy(argc > 2 ? std::stoi(argv[2]) : 1000000);
+    } else if (opt == "-benchtext") {
+        BenchTextParse(argc > 2 ? std::stoi(argv[2]) : 1000000);
+    } else if (opt == "-benchcomplete" and argc > 3) {
+        BenchComplete(argv[2], argv[3]);
+    } else if (opt == "-benchpath" and argc > 2) {
+        BenchPath(argv[2]);
+    } else if (opt == "-bench") {
+        BenchFolderItems();
+        BenchMemory();
+        BenchHints();
+        BenchHintThread();
+    } else {
+        std::cout << "Unknown option " << opt << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -44,7 +44,10 @@ using namespace std::chrono_literals;
 
 #include "ShellData.h"
 #include "History.h"
+#include "HistoryHint.h"
 #include "Utilities.h"
+#include "DirCache.h"
+#include "PathIndex.h"
 #include "Config.h"
 
 #define USELUA
@@ -62,10 +65,9 @@ protected:
   std::shared_ptr<ShellDataClass> shell;
   // ShellHistoryClass history;
 
-
-  std::chrono::high_resolution_clock hintClock;
-  int hintDelayMS;
-  std::chrono::time_point<std::chrono::high_resolution_clock> lastHint;
+  // hints are looked up off the input thread
+  HistoryHintClass hintWorker;
+  int hintWaitMS;
 
   bool debug;
 public:
@@ -75,21 +77,26 @@ public:
     bool Hint(const std::string &inp, CompletionItem &hint, const bool atEnd);
 
     virtual void AddHistory(const std::string &statement, const std::string &folder, const bool write);
+    void AddHistory(const std::string &statement, const std::string &folder, const bool write, const bool success);
 
+    void SetupCompletion();
     void ReadHistory(const std::string &name);
+    void SyncHistory();
+    void CheckCompaction();
 
     virtual int HistoryCount();
     virtual HistoryItemPtr GetHistoryItem(const ssize_t n) const;
     virtual void HistoryDelete(const ssize_t ind, const ssize_t n);
     virtual void HistoryAdd(const std::string &st);
+    virtual void HistorySearch(const std::string &pattern, const size_t max, std::vector<HistoryItemPtr> &matches);
 };
 
 
 ReadLineClass::ReadLineClass(std::shared_ptr<ShellDataClass> sh, const bool dbg) : 
   Crossline(new Utilities::FileCompleter(), new ShellHistoryClass()), shell(sh) 
 {
-    hintDelayMS = 300;
-    lastHint = hintClock.now();
+    shell->SetHistory(dynamic_cast<ShellHistoryClass*>(history));
+    hintWaitMS = 2;
     debug = dbg;
 }
 
@@ -99,61 +106,83 @@ ReadLineClass::ReadLineClass(std::shared_ptr<ShellDataClass> sh, const bool dbg)
 
 bool ReadLineClass::Hint(const std::string &inp, CompletionItem &hint, const bool atEnd)
 {
-#ifndef USE_CROSSLINE  
     // return hint for potential completion
     hint.comp = "";
     hint.delBefore = 0;
 
-    if (!atEnd) {
+    if (!atEnd or inp.empty()) {
       return false;      
     }
 
-    auto t1 = hintClock.now();
-    int delta = (t1 - lastHint) / 1ms;
-    if (delta < hintDelayMS) {
-      return false;
-    }
-    lastHint = t1;
-    
-    // need to search backwards for latest
-    std::string folder = shell->GetCurrentDir();
-    auto items = history.GetFolderItems(folder);
-    int no = items.size();
-    for (int i = no-1; i >= 0; i--) {
-      auto it = items[i];
-      if (Utilities::StartsWith(it->cmd, inp, false)) {
-        hint.delBefore = inp.length();
-        hint.comp = it->cmd;
-        return true;
+    // The hint, or else the line with its likeliest next token, is looked up
+    // by the hint thread and a key waits at most HistoryHintWaitMS for it.
+    // Each key supersedes the last one's lookup. The thread reads the
+    // history's index while it is added to here. Other shells' commands are
+    // read as they are written, a compacted file is read again at the prompt
+    // and the folder's older ones are loaded on cd
+    ShellHistoryClass *his = dynamic_cast<ShellHistoryClass*>(history);
+    his->Sync();
+    std::string cmd;
+    bool found = false;
+    if (hintWorker.IsRunning()) {
+      std::vector<HistoryFolderTreeClass::Ancestor> folders;
+      his->FindFolders(shell->GetCurrentDir(), folders);
+      uint64_t gen = hintWorker.Request(inp, his->GetIndex(), folders, shell->GetCurrentDir());
+      std::string pref;
+      if (!hintWorker.Wait(gen, hintWaitMS, found, cmd) and hintWorker.Latest(pref, found, cmd)) {
+        // not there yet, an earlier key's result is shown while it still fits
+        found = found and cmd.size() > inp.size() and cmd.compare(0, inp.size(), inp) == 0;
       }
-    }
-    items = history.GetNoFolderItems();
-    for (int i = items.size()-1; i >= 0; i--) {
-      auto it = items[i];
-      if (Utilities::StartsWith(it->cmd, inp, false)) {
-        hint.delBefore = inp.length();
-        hint.comp = it->cmd;
-        return true;
+    } else {
+      found = his->GetHint(inp, shell->GetCurrentDir(), cmd);
+      std::vector<std::string> next;
+      size_t start;
+      if (!found and his->PredictNext(inp, shell->GetCurrentDir(), 1, next, start)) {
+        cmd = inp.substr(0, start) + next[0];
+        found = true;
       }
     }
-#endif
-    // need to rewrite hints for Crossline
+    if (found) {
+      hint.delBefore = inp.length();
+      hint.comp = cmd;
+      return true;
+    }
     return false;
 }
 
 
 void ReadLineClass::AddHistory(const std::string &statement, const std::string &folder, const bool write)
 {
+  AddHistory(statement, folder, write, true);
+}
 
-  std::chrono::high_resolution_clock clock;
-  auto t1 = clock.now();
-  const auto t2 = std::chrono::system_clock::to_time_t(t1);
-  char nowSt[128];
-  std::strftime(nowSt, 128, "%Y-%m-%d %H:%M:%S", std::localtime(&t2));
-  // std::string nowSt = std::put_time(std::localtime(&t2), "%F %T.\n");
+
+void ReadLineClass::AddHistory(const std::string &statement, const std::string &folder, const bool write,
+                               const bool success)
+{
+  // failed commands count for less in hints
+  const auto now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
 
   ShellHistoryClass *his = dynamic_cast<ShellHistoryClass*>(history);
-  his->Append(statement, folder, nowSt, write);
+  his->Append(statement, folder, now, write, success);
+}
+
+
+void ReadLineClass::SetupCompletion()
+{
+   // folder listings for completion are kept until they change, in up to CompletionCacheMB
+   DirCacheClass::Get().SetLimit(size_t(std::max(0, shell->GetIntVariable("CompletionCacheMB", 16))) * 1024*1024);
+   // Tab shows up to CompletionMax matches, or those found in CompletionMS,
+   // and Tab again the next ones
+   Utilities::FileCompleter *files = dynamic_cast<Utilities::FileCompleter*>(completer);
+   files->SetLimits(std::max(2, shell->GetIntVariable("CompletionMax", 1000)),
+                    std::max(1, shell->GetIntVariable("CompletionMS", 50)));
+   // command names are completed from the shell's commands and aliases, then
+   // the executables in PATH, which are read on a thread
+   files->SetCommands([this](const std::string &pref, const std::function<bool(const std::string &name)> &found) {
+     return shell->FindCommands(pref, found);
+   });
+   PathIndexClass::Get().Start();
 }
 
 
@@ -163,19 +192,85 @@ void ReadLineClass::ReadHistory(const std::string &name)
 
    ShellHistoryClass *his = dynamic_cast<ShellHistoryClass*>(history);
    his->Clear();
+   // a large history is loaded on HistoryLoadThreads threads, 0 for one per core
+   his->SetLoadThreads(shell->GetIntVariable("HistoryLoadThreads", 0));
+   // hints are ranked by frecency, a use counts half as much after HistoryHintHalfLife hours
+   his->SetHalfLife(shell->GetIntVariable("HistoryHintHalfLife", 72));
+   // only the newest HistoryHotItems are loaded with up to HistoryFolderItems
+   // older ones for each folder used, HistoryMemoryMB limits loading more
+   his->SetWindow(shell->GetIntVariable("HistoryHotItems", 10000), 
+                  shell->GetIntVariable("HistoryFolderItems", 200),
+                  size_t(shell->GetIntVariable("HistoryMemoryMB", 64)) * 1024*1024);
+   // the older records are split into HistoryShards shards by folder, so a
+   // folder's are found from its shard, 0 turns them off
+   his->SetShards(std::max(0, shell->GetIntVariable("HistoryShards", 256)));
    his->Load(inPath.string());
+   his->UseFolder(shell->GetCurrentDir());
+
+   // commands are written by a background thread, HistoryDurability is
+   // none, flush (the default) or fsync
+   auto dur = HistoryWriterClass::ParseDurability(shell->GetVariable("HistoryDurability", "flush"));
+   his->StartWriter(dur, shell->GetIntVariable("HistoryFlushMS", 1000), 
+                    shell->GetIntVariable("HistoryBatch", 16));
+
+   // HistoryHintWaitMS bounds the time a key waits for its hint
+   hintWaitMS = shell->GetIntVariable("HistoryHintWaitMS", 2);
+   hintWorker.Start([his](const std::string &line, const std::string &folder, std::string &hint) {
+     std::vector<std::string> next;
+     size_t start;
+     if (!his->PredictNext(line, folder, 1, next, start)) {
+       return false;
+     }
+     hint = line.substr(0, start) + next[0];
+     return true;
+   });
+}
+
+
+void ReadLineClass::SyncHistory()
+{
+    // pick up commands from other shells, reading a compacted file again
+    ShellHistoryClass *his = dynamic_cast<ShellHistoryClass*>(history);
+    his->Refresh();
+
+    std::string msg;
+    if (his->CompactResult(msg)) {
+      PrintStr(msg + "\n");
+    }
+}
+
+
+void ReadLineClass::CheckCompaction()
+{
+    // compact in the background when the history has grown or has many repeats
+    ShellHistoryClass *his = dynamic_cast<ShellHistoryClass*>(history);
+    if (shell->GetIntVariable("HistoryAutoCompact", 0) == 0) {
+      return;
+    }
+    int maxItems = shell->GetIntVariable("HistoryCompactItems", 20*1024);
+    double maxRatio = shell->GetIntVariable("HistoryCompactRepeats", 50) / 100.0;
+    int noItems = his->GetNoHistory();
+    double ratio = his->DuplicateRatio();
+    if (noItems > maxItems or (noItems > 1000 and ratio > maxRatio)) {
+      std::ostringstream msg;
+      msg << "Compacting history with " << noItems << " items, " << int(ratio*100) << "% repeats";
+      Utilities::LogMessage(msg.str());
+      his->Compact(shell->GetHistoryRetention());
+    }
 }
 
 
 int ReadLineClass::HistoryCount() 
 {
-    return history->Size();
+    ShellHistoryClass *his = dynamic_cast<ShellHistoryClass*>(history);
+    return his->GetNoHistory();
 }
 
 
 HistoryItemPtr ReadLineClass::GetHistoryItem(const ssize_t n) const
 {
-  int no = history->Size();
+  ShellHistoryClass *his = dynamic_cast<ShellHistoryClass*>(history);
+  int no = his->GetNoHistory();
   int ind = n;
   // interpret < 0 as from end
   if (n < 0) {
@@ -184,8 +279,12 @@ HistoryItemPtr ReadLineClass::GetHistoryItem(const ssize_t n) const
   if (ind < 0) {
     return std::make_shared<CrabHistoryItem>("", "", "");
   }
+  // older items are loaded as the oldest loaded one is reached
+  ind = his->Reach(ind);
+  no = his->GetNoHistory();
   if (ind <= no) {    // the call starts at 1
-    HistoryItemPtr ptr = history->GetHistoryItem(ind);
+    // the same items Crossline reads through the history
+    HistoryItemPtr ptr = his->GetItem(ind);
     std::string st = ptr->item;
 
     std::ostringstream msg;
@@ -202,6 +301,20 @@ void ReadLineClass::HistoryDelete(const ssize_t ind, const ssize_t n)
 void ReadLineClass::HistoryAdd(const std::string &st)
 {}
 
+void ReadLineClass::HistorySearch(const std::string &pattern, const size_t max, std::vector<HistoryItemPtr> &matches)
+{
+  // Ctrl-R, the newest commands containing pattern. The whole file is
+  // searched through its trigram index, built on a thread from when the
+  // history is loaded, until then the loaded commands are looked through
+  ShellHistoryClass *his = dynamic_cast<ShellHistoryClass*>(history);
+  std::vector<std::string> cmds;
+  his->SubstringSearch(pattern, max, cmds);
+  matches.clear();
+  for (const auto &cmd : cmds) {
+    matches.push_back(std::make_shared<CrabHistoryItem>(cmd, "", ""));
+  }
+}
+
 int ShellDataClass::GetPaths()
 {
   // set currentDir and root
@@ -281,6 +394,10 @@ bool ShellDataClass::DoCD(const std::string &d, const bool push)
   }
 
   GetPaths();
+  if (history != nullptr) {
+    // the new folder's older history comes from its shard
+    history->UseFolder(GetCurrentDir());
+  }
 
   return true;
 }
@@ -292,6 +409,9 @@ bool ShellDataClass::PopDir()
     Utilities::SetCurrentDirectory(dir);
     pushDirs.pop_back();
     GetPaths();
+    if (history != nullptr) {
+      history->UseFolder(GetCurrentDir());
+    }
   }
   return true;
 }
@@ -303,6 +423,61 @@ void ShellDataClass::AddAlias(const std::string &alias, const std::string &cmd)
 }
 
 
+bool ShellDataClass::FindCommands(const std::string &pref,
+                                  const std::function<bool(const std::string &name)> &found) const
+{
+  // both are kept in name order
+  for (auto it = funcs.lower_bound(pref); it != funcs.end() and Utilities::StartsWith(it->first, pref); it++) {
+    if (!found(it->first)) {
+      return true;
+    }
+  }
+  for (auto it = aliases.lower_bound(pref); it != aliases.end() and Utilities::StartsWith(it->first, pref); it++) {
+    if (!found(it->first)) {
+      return true;
+    }
+  }
+  return true;
+}
+
+
+HistoryRetention ShellDataClass::GetHistoryRetention() const
+{
+  HistoryRetention keep;
+  keep.maxEntries = std::max(0, GetIntVariable("HistoryMaxItems", 0));
+  keep.maxDays = std::max(0, GetIntVariable("HistoryMaxDays", 0));
+  return keep;
+}
+
+
+void ShellDataClass::SetVariable(const std::string &var, const std::string &val)
+{
+  variables[var] = val;
+}
+
+
+std::string ShellDataClass::GetVariable(const std::string &var, const std::string &def) const
+{
+  auto it = variables.find(var);
+  if (it != variables.end()) {
+    return it->second;
+  }
+  return def;
+}
+
+
+int ShellDataClass::GetIntVariable(const std::string &var, const int def) const
+{
+  std::string val = GetVariable(var);
+  try {
+    return val.empty() ? def : std::stoi(val);
+  } catch (std::exception &e) {
+    Utilities::LogMessage("Invalid value for " + var + ": " + val);
+  }
+  return def;
+}
+
+
 // various hooks for lua
 bool ShellDataClass::RunHook(const HookData &data)
 {
@@ -423,15 +598,15 @@ bool ShellDataClass::ProcessCommand(const std::string &commandLineArg)
   }
   cmdLine += args.back().cmd;
 
-  std::system(cmdLine.c_str());
-
-  return true;
+  // the exit status only marks the command as failed in the history
+  return std::system(cmdLine.c_str()) == 0;
 }
 
 
 namespace ShellFuncs {
 
   bool ExitFunc(const std::vector<std::string> &args, ShellDataClass &shell) {
+    // queued history is written by the history writer's atexit handler
     exit(1);
     return 1;
   }
@@ -460,6 +635,55 @@ namespace ShellFuncs {
     return shell.PopDir();
   }
 
+  bool HistorySearch(const std::vector<std::string> &args, ShellDataClass &shell) {
+    // history [-n count] [-s] [query], fuzzy matches with the best last, or
+    // with -s the newest commands containing query
+    ShellHistoryClass *his = shell.GetHistory();
+    if (his == nullptr) {
+      return false;
+    }
+    size_t count = 20;
+    bool substring = false;
+    std::string query;
+    for (size_t i = 1; i < args.size(); i++) {
+      if (args[i] == "-n" and i+1 < args.size()) {
+        count = std::max(1, std::atoi(args[++i].c_str()));
+      } else if (args[i] == "-s") {
+        substring = true;
+      } else {
+        query += (query.empty() ? "" : " ") + args[i];
+      }
+    }
+    if (substring) {
+      std::vector<std::string> res;
+      his->SubstringSearch(query, count, res);
+      for (auto it = res.rbegin(); it != res.rend(); it++) {
+        std::cout << "  " << *it << "\n";
+      }
+      return true;
+    }
+    std::vector<HistoryEntry> res;
+    his->FuzzySearch(query, count, res);
+    for (auto it = res.rbegin(); it != res.rend(); it++) {
+      std::cout << "  " << it->cmd << "\n";
+    }
+    return true;
+  }
+
+  bool CompactHistory(const std::vector<std::string> &args, ShellDataClass &shell) {
+    // runs in the background, the result is shown before a later prompt
+    ShellHistoryClass *his = shell.GetHistory();
+    if (his == nullptr) {
+      return false;
+    }
+    if (!his->Compact(shell.GetHistoryRetention())) {
+      Utilities::LogError("Error: history compaction is already running\n");
+      return false;
+    }
+    std::cout << "Compacting history in the background\n";
+    return true;
+  }
+
 
   std::string ExpandVars(const std::string &st) {
     // expand any environment variables in st
@@ -530,10 +754,11 @@ namespace ShellFuncs {
         std::string var = cmd.substr(0, pos);
         std::string val = cmd.substr(pos+1);
         val = ExpandVars(val);
-        // _putenv_s(var.c_str(), val.c_str());
-        std::string cmd = var + "=" + val;
-        putenv(const_cast<char*>(cmd.c_str()));
-        // SetEnvironmentVariable(var.c_str(), val.c_str());
+        Utilities::SetEnvVar(var, val);
+        if (Utilities::ToLower(var) == "path") {
+          // the command names are read again in the background
+          PathIndexClass::Get().Refresh();
+        }
         return 1;
       }
     } else {
@@ -558,6 +783,7 @@ ShellDataClass::ShellDataClass(const bool useLog, const std::string &localConfig
 
   configFolder = Utilities::GetConfigFolder();
   doLog = useLog;  
+  history = nullptr;
 
   funcs["exit"] = &ShellFuncs::ExitFunc;
   funcs["cd"] = &ShellFuncs::CD;
@@ -566,6 +792,8 @@ ShellDataClass::ShellDataClass(const bool useLog, const std::string &localConfig
   funcs["popd"] = &ShellFuncs::PopDir;
   funcs["setcolour"] = &ShellFuncs::SetColour;
   funcs["set"] = &ShellFuncs::SetEnv;
+  funcs["compacthistory"] = &ShellFuncs::CompactHistory;
+  funcs["history"] = &ShellFuncs::HistorySearch;
   maxPrompt = 25;
 
   std::string configFile;
@@ -706,15 +934,18 @@ int main(int argc, char* argv[])
     // Set the maximum number of search items to return
     readLine.HistorySetSearchMaxCount(12);
 
+    readLine.SetupCompletion();
+
     readLine.HistorySetup(true);
-    // enable history; use a NULL filename to not persist history to disk
-    readLine.ReadHistory("history.dat");
+    // enable history; an old history.dat is converted to history.bin on first use
+    readLine.ReadHistory("history.bin");
 
-    if (readLine.HistoryCount() > 20*1024) {
+    if (readLine.HistoryCount() > 20*1024 and shell->GetIntVariable("HistoryAutoCompact", 0) == 0) {
       std::ostringstream msg;
-      msg << "Have " << readLine.HistoryCount() << " history items. Suggest running CleanHistory\n\n";
+      msg << "Have " << readLine.HistoryCount() << " history items. Suggest running compacthistory\n\n";
       readLine.PrintStr(msg.str());
     }
+    readLine.CheckCompaction();
 
 
     while(true) {
@@ -725,6 +956,8 @@ int main(int argc, char* argv[])
       }
       prompt += "> ";
 
+      readLine.SyncHistory();
+
       std::string input;
       if (readLine.ReadLine(prompt, input)) {   // ctrl-d returns NULL (as well as errors)
         try {
@@ -735,7 +968,7 @@ int main(int argc, char* argv[])
           } 
 
           if (input.length() > 0)  {
-            readLine.AddHistory(input, curDir, !debug);
+            readLine.AddHistory(input, curDir, !debug, res);
           }
           if (not res) {
             std::string err;
@@ -0,0 +1,692 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2024, John Burnell
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  CrabTest.cpp
+  Tests of the history file lock, completion and the history frecency
+-----------------------------------------------------------------------------*/
+
+#include <fstream>
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <filesystem>
+namespace fs = std::filesystem;
+
+#ifndef __WIN32__
+# include <unistd.h>
+# include <sys/wait.h>
+#endif
+
+#include "History.h"
+#include "HistoryCompact.h"
+#include "HistoryHint.h"
+#include "Utilities.h"
+#include "DirCache.h"
+#include "PathIndex.h"
+
+
+static int noFailed = 0;
+
+static void Check(const bool ok, const std::string &what)
+{
+    if (!ok) {
+        std::cout << "  FAILED: " << what << "\n";
+        noFailed++;
+    }
+}
+
+
+static std::string Complete(const std::string &line, const Utilities::NameSource &commands=nullptr)
+{
+    // the completions of line, separated by blanks
+    std::string res;
+    int startPos;
+    Utilities::GetCompletions(line, [&res](CompletionItem &&item) {
+        res += item.GetWord() + " ";
+        return true;
+    }, startPos, commands);
+    return res;
+}
+
+
+static std::string Listed(const std::string &folder)
+{
+    std::string res;
+    DirCacheClass::Get().Find(folder, "", [&res](const DirCacheClass::Entry &ent) {
+        res += ent.name + " ";
+        return true;
+    });
+    return res;
+}
+
+
+static void Touch(const fs::path &file, const bool executable=false)
+{
+    std::ofstream(file.string()).close();
+    if (executable) {
+        fs::permissions(file, fs::perms::owner_all, fs::perm_options::add);
+    }
+}
+
+
+static void WriteHistory(const std::string &file, const std::vector<std::string> &cmds,
+                         const std::vector<std::string> &folders, const int64_t start=1750000000)
+{
+    // a compacted file, with an index, of cmds in folders taken in turn
+    std::vector<HistoryFileClass::Record> recs;
+    for (size_t i = 0; i < cmds.size(); i++) {
+        recs.push_back({start + int64_t(i), 0, cmds[i], folders[i % folders.size()]});
+    }
+    HistoryFileClass::Write(file, recs);
+}
+
+
+template <typename Ready>
+static bool WaitFor(const Ready &ready)
+{
+    // for up to 10 seconds, for a thread building an index
+    for (int i = 0; i < 10000; i++) {
+        if (ready()) {
+            return true;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return false;
+}
+
+
+static std::string Cmds(const std::vector<HistoryFileClass::Record> &recs)
+{
+    std::string res;
+    for (const auto &rec : recs) {
+        res += std::string(rec.cmd) + ";";
+    }
+    return res;
+}
+
+
+void TestLock(const fs::path &dir)
+{
+    // another process holding the lock exclusively is waited for only as
+    // long as asked, and its lock is had once it exits
+#ifndef __WIN32__
+    std::string file = (dir / "history.bin").string();
+    int pipeFds[2];
+    if (pipe(pipeFds) != 0) {
+        Check(false, "pipe for the lock test");
+        return;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        Utilities::FileLock lck(file);
+        char held = lck.HasLock() ? 'y' : 'n';
+        if (write(pipeFds[1], &held, 1) != 1) {
+            _exit(1);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(600));
+        _exit(0);
+    }
+    char held = 'n';
+    Check(read(pipeFds[0], &held, 1) == 1 and held == 'y', "other process takes the lock");
+    close(pipeFds[0]);
+    close(pipeFds[1]);
+
+    auto t0 = std::chrono::steady_clock::now();
+    {
+        Utilities::FileLock lck(file, true, 100);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        Check(!lck.HasLock(), "shared lock not had while held exclusively");
+        Check(ms >= 90 and ms < 500, "gave up after about 100 ms, took " + std::to_string(ms));
+    }
+    {
+        Utilities::FileLock lck(file, false, 5000);
+        Check(lck.HasLock(), "exclusive lock had once the other process exits");
+    }
+    int status;
+    waitpid(pid, &status, 0);
+
+    // shared locks are held together
+    Utilities::FileLock first(file, true, 0);
+    Utilities::FileLock second(file, true, 0);
+    Check(first.HasLock() and second.HasLock(), "two shared locks");
+#endif
+}
+
+
+void TestLockedAppend(const fs::path &dir)
+{
+    // a command appended while another process holds the lock, as for a
+    // compaction, is kept and written once the lock is had
+#ifndef __WIN32__
+    std::string file = (dir / "locked.bin").string();
+    ShellHistoryClass history;
+    history.Load(file);
+    int pipeFds[2];
+    if (pipe(pipeFds) != 0) {
+        Check(false, "pipe for the locked append test");
+        return;
+    }
+    pid_t pid = fork();
+    if (pid == 0) {
+        Utilities::FileLock lck(file);
+        char held = lck.HasLock() ? 'y' : 'n';
+        if (write(pipeFds[1], &held, 1) != 1) {
+            _exit(1);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(Utilities::FileLock::defaultWaitMS + 500));
+        _exit(0);
+    }
+    char held = 'n';
+    Check(read(pipeFds[0], &held, 1) == 1 and held == 'y', "other process takes the lock");
+    close(pipeFds[0]);
+    close(pipeFds[1]);
+    uintmax_t size = fs::file_size(file);
+    history.Append("crabtest locked", "/work", 1750000000, true, true);
+    Check(fs::file_size(file) == size, "not written while locked");
+    int status;
+    waitpid(pid, &status, 0);
+    history.Flush();
+
+    ShellHistoryClass other;
+    other.Load(file);
+    Check(other.GetNoHistory() == 1, "command appended while locked is written");
+#endif
+}
+
+
+void TestVariables()
+{
+    // a variable set is completed straight away, as is one set while
+    // another has gone
+    Check(Complete("echo $CRABTEST_").empty(), "no variables before set");
+    Utilities::SetEnvVar("CRABTEST_A", "1");
+    Check(Complete("echo $CRABTEST_") == "$CRABTEST_A ", "variable set is completed");
+#ifndef __WIN32__
+    unsetenv("CRABTEST_A");
+#endif
+    Utilities::SetEnvVar("CRABTEST_B", "2");
+    Check(Complete("echo x$CRABTEST_").find("$CRABTEST_B") != std::string::npos, "variable set after another went");
+}
+
+
+void TestFolderCache(const fs::path &dir)
+{
+    // a cached listing is dropped when its folder changes, including when
+    // it is listed through a link too
+    fs::path folder = dir / "cache";
+    fs::create_directory(folder);
+    Touch(folder / "one");
+    Check(Listed(folder.string()) == "one ", "first listing");
+    Touch(folder / "two");
+    Check(Listed(folder.string()) == "one two ", "file added after listing");
+#ifdef __linux__
+    fs::path link = dir / "cachelink";
+    fs::create_directory_symlink(folder, link);
+    Check(Listed(link.string()) == "one two ", "listing through a link");
+    Touch(folder / "three");
+    Check(Listed(folder.string()) == "one three two ", "folder after a change, listed by both paths");
+    Check(Listed(link.string()) == "one three two ", "link after a change, listed by both paths");
+#endif
+}
+
+
+void TestCancel(const fs::path &dir)
+{
+    // stop is checked as a listing is walked even when nothing matches, as
+    // in completing a folder name among many files
+    fs::path folder = dir / "many";
+    fs::create_directory(folder);
+    for (int i = 0; i < 5000; i++) {
+        Touch(folder / ("file" + std::to_string(i)));
+    }
+    Listed(folder.string());
+    int noStops = 0;
+    int startPos;
+    bool res = Utilities::GetCompletions("cd " + folder.string() + Utilities::pathSep, [](CompletionItem &&) {
+        return true;
+    }, startPos, nullptr, [&noStops]() {
+        return ++noStops == 3;
+    });
+    Check(!res and noStops == 3, "walk stopped, stop called " + std::to_string(noStops) + " times");
+
+    // and a folder that cannot be read fails rather than finding nothing
+    res = Utilities::GetCompletions("ls " + (dir / "missing" / "x").string(), [](CompletionItem &&) {
+        return true;
+    }, startPos);
+    Check(!res, "missing folder fails");
+}
+
+
+void TestPath(const fs::path &dir)
+{
+    // commands in PATH are found, and found again once a folder or PATH changes
+    fs::path first = dir / "bin1";
+    fs::path second = dir / "bin2";
+    fs::create_directory(first);
+    fs::create_directory(second);
+    Touch(first / "crabtestone", true);
+    Touch(first / "crabtestdata");
+    Utilities::SetEnvVar("PATH", first.string());
+    PathIndexClass::Get().Refresh();
+    Check(Complete("crabtest") == "crabtestone ", "executable in PATH, not the data file");
+
+    // folders are checked at most every checkMS
+    Touch(first / "crabtesttwo", true);
+    std::this_thread::sleep_for(std::chrono::milliseconds(PathIndexClass::checkMS + 100));
+    Check(Complete("crabtest") == "crabtestone crabtesttwo ", "executable added to a PATH folder");
+
+    Touch(second / "crabtestthree", true);
+    Utilities::SetEnvVar("PATH", first.string() + (Utilities::IsWindows() ? ";" : ":") + second.string());
+    PathIndexClass::Get().Refresh();
+    Check(Complete("crabtest") == "crabtestone crabtestthree crabtesttwo ", "folder added to PATH");
+}
+
+
+void TestRouting(const fs::path &dir)
+{
+    // the word is completed from the source for where it is
+    fs::path folder = dir / "route";
+    fs::create_directory(folder);
+    fs::create_directory(folder / "subdir");
+    Touch(folder / "subfile");
+    fs::path bin = dir / "routebin";
+    fs::create_directory(bin);
+    Touch(bin / "crabroute", true);
+    Utilities::SetEnvVar("PATH", bin.string());
+    PathIndexClass::Get().Refresh();
+    Utilities::SetEnvVar("CRABROUTE", "1");
+    Utilities::SetCurrentDirectory(folder.string());
+
+    Utilities::NameSource commands = [](const std::string &pref, const std::function<bool(const std::string &name)> &found) {
+        for (std::string name : {"crabalias", "cd"}) {
+            if (Utilities::StartsWith(name, pref) and !found(name)) {
+                break;
+            }
+        }
+        return true;
+    };
+    std::string sep(1, Utilities::pathSep);
+    Check(Complete("crab", commands) == "crabalias crabroute ", "command from the shell then PATH");
+    Check(Complete("ls | crab", commands) == "crabalias crabroute ", "command after a pipe");
+    Check(Complete("cd sub", commands) == "subdir" + sep + " ", "folders only after cd");
+    Check(Complete("ls sub", commands) == "subdir" + sep + " subfile ", "files as an argument");
+    Check(Complete("ls > sub", commands) == "subdir" + sep + " subfile ", "files after a redirection");
+    Check(Complete("echo $CRABROU", commands) == "$CRABROUTE ", "variable after $");
+    Utilities::SetCurrentDirectory(dir.string());
+}
+
+
+void TestCompactFrecency(const fs::path &dir)
+{
+    // compaction merges the uses of a command into its newest, the frecency
+    // and the failures are kept
+    std::string file = (dir / "compact.bin").string();
+    const int64_t now = 1750000000;
+    {
+        ShellHistoryClass history;
+        history.Load(file);
+        for (int i = 0; i < 200; i++) {
+            history.Append("make " + std::to_string(i % 7), "/work/" + std::to_string(i % 3), now - 3600*(200-i), true,
+                           i % 5 != 0);
+        }
+    }
+    std::vector<std::string> cmds = {"make 0", "make 3", "make 6"};
+    std::vector<double> before;
+    {
+        ShellHistoryClass history;
+        history.Load(file);
+        for (const auto &cmd : cmds) {
+            before.push_back(history.GetFrecency(cmd, "", now));
+            before.push_back(history.GetFrecency(cmd, "/work/1", now));
+        }
+    }
+    HistoryRetention keep = {0, 0};
+    std::string msg;
+    Check(HistoryCompactorClass::Compact(file, keep, msg), "compacted: " + msg);
+    ShellHistoryClass history;
+    history.Load(file);
+    Check(history.GetNoHistory() < 200, "fewer records after compaction");
+    for (size_t i = 0; i < cmds.size(); i++) {
+        double global = history.GetFrecency(cmds[i], "", now);
+        double inFolder = history.GetFrecency(cmds[i], "/work/1", now);
+        Check(std::abs(global - before[2*i]) <= 1e-4 * before[2*i], "frecency of " + cmds[i] + " kept");
+        Check(std::abs(inFolder - before[2*i+1]) <= 1e-4 * before[2*i+1], "frecency of " + cmds[i] + " in a folder kept");
+    }
+}
+
+
+void TestHintWorker(const fs::path &dir)
+{
+    // the hint thread gives the history's hint or else the next token, and
+    // a result is kept for later keys when it comes after its key stopped
+    // waiting
+    std::string file = (dir / "hint.bin").string();
+    ShellHistoryClass history;
+    history.Load(file);
+    for (int i = 0; i < 300; i++) {
+        history.Append("git checkout branch" + std::to_string(i % 3), "/work", 1750000000 + i, true);
+    }
+    HistoryHintClass worker;
+    worker.Start([&history](const std::string &line, const std::string &folder, std::string &hint) {
+        std::vector<std::string> next;
+        size_t start;
+        if (!history.PredictNext(line, folder, 1, next, start)) {
+            return false;
+        }
+        hint = line.substr(0, start) + next[0];
+        return true;
+    });
+    std::vector<HistoryFolderTreeClass::Ancestor> folders;
+    history.FindFolders("/work", folders);
+    bool found = false;
+    std::string hint;
+    uint64_t gen = worker.Request("git ch", history.GetIndex(), folders, "/work");
+    Check(worker.Wait(gen, 1000, found, hint) and found and hint == "git checkout branch2", "hint from the history");
+
+    // a line no command starts with is completed with its next token
+    gen = worker.Request("sudo git checkout b", history.GetIndex(), folders, "/work");
+    Check(worker.Wait(gen, 1000, found, hint) and found and Utilities::StartsWith(hint, "sudo git checkout branch"),
+          "next token found by the hint thread: " + hint);
+
+    gen = worker.Request("git che", history.GetIndex(), folders, "/work");
+    worker.Wait(gen, 0, found, hint);
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    std::string pref;
+    Check(worker.Latest(pref, found, hint) and pref == "git che" and found and hint == "git checkout branch2",
+          "late result kept");
+    worker.Stop();
+}
+
+
+void TestFileRecords(const fs::path &dir)
+{
+    // a damaged record in the tail is skipped, one cut short at the end
+    // stops the scan, and a damaged index is scanned past
+    std::string file = (dir / "records.bin").string();
+    WriteHistory(file, {"one", "two", "three"}, {"/work"});
+    std::string tail;
+    std::vector<size_t> ends;
+    for (std::string cmd : {"four", "five", "six", "seven"}) {
+        HistoryFileClass::EncodeRecord({1750000100, 0, cmd, "/work"}, tail);
+        ends.push_back(tail.size());
+    }
+    tail[ends[1] - 1] ^= 0x20;                   // the end of "five"
+    tail.resize(tail.size() - 3);                // part of "seven"
+    uint64_t tailStart = fs::file_size(file);
+    HistoryFileClass::AppendData(file, tail);
+    {
+        HistoryFileClass hist;
+        std::vector<HistoryFileClass::Record> recs;
+        Check(hist.Open(file) and hist.GetRecords(recs), "file with damaged records is read");
+        Check(Cmds(recs) == "one;two;three;four;six;", "damaged and cut records left out: " + Cmds(recs));
+        Check(hist.ValidEnd() == tailStart + ends[2], "valid end before the cut record");
+    }
+
+    // a count in the header large enough to overflow is taken as a damaged index
+    {
+        std::fstream fst(file, std::ios::in | std::ios::out | std::ios::binary);
+        uint64_t count = uint64_t(1) << 61;
+        fst.seekp(24);
+        fst.write(reinterpret_cast<const char*>(&count), sizeof(count));
+    }
+    HistoryFileClass hist;
+    std::vector<HistoryFileClass::Record> recs;
+    Check(hist.Open(file) and hist.GetRecords(recs), "file with a damaged index is read");
+    Check(hist.NoIndexed() == 0 and Cmds(recs) == "one;two;three;four;six;", "records found by scanning: " + Cmds(recs));
+}
+
+
+void TestListDedup()
+{
+    // a repeated command moves to the end and the n'th command is found
+    // through the tree, also once the moved slots have been squeezed out
+    HistoryListClass list;
+    Check(list.Add("ls", 0) == HistoryListClass::noEntry and list.Add("make", 1) == HistoryListClass::noEntry,
+          "new commands");
+    Check(list.Add("ls", 2) == 0, "repeat replaces its entry");
+    Check(list.Size() == 2 and list.Get(0) == 1 and list.Get(1) == 2 and list.Last() == 2, "repeat moved to the end");
+    Check(list.Find("ls") == 2 and list.Position("ls") == 1 and list.Position("cd") == HistoryListClass::noEntry,
+          "found by command");
+    list.Add("cd", 3);
+    for (uint32_t i = 4; i < 5000; i++) {
+        list.Add(i % 2 ? "make" : "ls", i);
+    }
+    Check(list.Size() == 3 and list.Get(0) == 3 and list.Get(1) == 4998 and list.Get(2) == 4999,
+          "order after many repeats");
+    Check(list.Slots().size() < 2048, "moved slots squeezed out, " + std::to_string(list.Slots().size()) + " slots");
+}
+
+
+void TestTrieBest()
+{
+    // each prefix gives the command with the highest rank, then the newest
+    HistoryTrieClass trie;
+    trie.Insert("git status", 0, 1.0f);
+    trie.Insert("git stash", 1, 2.0f);
+    Check(trie.Find("git st") == 1 and trie.Find("git stat") == 0, "best by rank");
+    trie.Insert("git status", 2, 3.0f);
+    Check(trie.Find("git st") == 2 and trie.Find("g") == 2 and trie.Find("git stas") == 1, "rank raised by a use");
+    trie.Insert("git", 3, 0.5f);
+    Check(trie.Find("gi") == 2 and trie.Find("git") == 2, "edge split keeps the best");
+    trie.Insert("ls", 4);
+    trie.Insert("lsof", 5);
+    Check(trie.Find("ls") == 5 and trie.Find("lso") == 5, "newest with the same rank");
+    Check(trie.Find("gx") == HistoryTrieClass::noEntry and trie.Find("lsofx") == HistoryTrieClass::noEntry,
+          "no match");
+}
+
+
+void TestTailSync(const fs::path &dir)
+{
+    // commands from another shell are read on Sync, a compacted file is
+    // only read again on Refresh
+    std::string file = (dir / "sync.bin").string();
+    const int64_t now = 1750000000;
+    ShellHistoryClass first, second;
+    first.Load(file);
+    second.Load(file);
+    for (int i = 0; i < 20; i++) {
+        first.Append("make " + std::to_string(i % 4), "/work", now + i, true);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    Check(second.Sync() and second.GetNoHistory() == 4, "other shell's commands read");
+    Check(!second.Sync(), "nothing more to read");
+    std::string hint;
+    Check(second.GetHint("make", "/work", hint) and hint == "make 3", "hint from the other shell");
+
+    HistoryRetention keep;
+    std::string msg;
+    Check(HistoryCompactorClass::Compact(file, keep, msg), "compacted: " + msg);
+    first.Append("cargo build", "/work", now + 100, true);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    Check(!second.Sync() and second.GetNoHistory() == 4, "replaced file left for Refresh");
+    second.Refresh();
+    Check(second.GetNoHistory() == 5 and second.GetItem(4)->item == "cargo build", "replaced file read again");
+}
+
+
+void TestShards(const fs::path &dir)
+{
+    // the shards give a folder's newest records before a record
+    std::string file = (dir / "shards.bin").string();
+    std::vector<std::string> cmds;
+    for (int i = 0; i < 100; i++) {
+        cmds.push_back("cmd " + std::to_string(i));
+    }
+    WriteHistory(file, cmds, {"/f0", "/f1", "/f2", "/f3", "/f4"});
+    HistoryFileClass hist;
+    Check(hist.Open(file), "file for the shards");
+    HistoryShardClass shards;
+    Check(WaitFor([&]() {return shards.Update(file, hist, 4);}), "shards built");
+    std::vector<uint64_t> inds;
+    shards.FolderRecords(hist, "/f2", 5, 100, inds);
+    Check(inds == std::vector<uint64_t>({77, 82, 87, 92, 97}), "newest of a folder");
+    shards.FolderRecords(hist, "/f2", 3, 50, inds);
+    Check(inds == std::vector<uint64_t>({37, 42, 47}), "newest of a folder before a record");
+    shards.FolderRecords(hist, "/none", 3, 100, inds);
+    Check(inds.empty(), "folder with no records");
+
+    // and are read by another shell
+    HistoryShardClass other;
+    Check(other.Update(file, hist, 4), "shards read");
+}
+
+
+void TestNextTable(const fs::path &dir)
+{
+    // the next token is predicted from the file, from the saved table, and
+    // from commands added since
+    std::string file = (dir / "next.bin").string();
+    std::vector<std::string> cmds;
+    for (int i = 0; i < 300; i++) {
+        cmds.push_back(i % 3 ? "git checkout main" : "git commit -a");
+    }
+    WriteHistory(file, cmds, {"/work"});
+    std::vector<std::string> res;
+    size_t start;
+    {
+        HistoryNextClass next;
+        Check(WaitFor([&]() {return next.Update(file) and !next.Building();}), "table built");
+        Check(next.Predict("git ", "/work", 2, res, start) and res == std::vector<std::string>({"checkout", "commit"}) and
+              start == 4, "tokens after git");
+        Check(next.Predict("git checkout m", "", 1, res, start) and res[0] == "main" and start == 13,
+              "token completed in all folders");
+        Check(fs::exists(file + ".nxt"), "table saved");
+    }
+    HistoryNextClass next;
+    Check(next.Update(file) and next.NoContexts() > 0, "saved table read");
+    Check(next.Predict("git ", "/work", 1, res, start) and res[0] == "checkout", "tokens from the saved table");
+    for (int i = 0; i < 5; i++) {
+        next.Add("make install", "/work", 0);
+    }
+    next.Add("make clean", "/work", HistoryFileClass::failedFlag);
+    Check(next.Predict("make ", "/work", 2, res, start) and res == std::vector<std::string>({"install"}),
+          "added commands counted, failed ones not");
+}
+
+
+void TestSearch(const fs::path &dir)
+{
+    // fuzzy search of the loaded commands
+    HistoryFuzzyClass fuzzy;
+    fuzzy.Add("git status", 10);
+    fuzzy.Add("grep -r todo", 11);
+    fuzzy.Add("git stash", 12);
+    fuzzy.Add("gist show", 5);                   // an older one loaded later
+    std::vector<HistoryFuzzyClass::Match> matches;
+    fuzzy.Search("gst", 10, matches);
+    Check(matches.size() == 3, "subsequence matches, " + std::to_string(matches.size()));
+    fuzzy.Remove(10);
+    fuzzy.Remove(5);
+    fuzzy.Search("gst", 10, matches);
+    Check(matches.size() == 1 and matches[0].entry == 12, "removed entries not matched");
+    Check(HistoryFuzzyClass::Score("git status", "gs", false) > HistoryFuzzyClass::Score("grep -r todo", "g", false) and
+          HistoryFuzzyClass::Score("git status", "xyz", false) < 0, "scores");
+
+    // substring search of the file through the trigram index
+    std::string file = (dir / "search.bin").string();
+    WriteHistory(file, {"git status", "make all", "Git Status -s", "git status", "ls"}, {"/work"});
+    HistoryTrigramClass trigrams;
+    Check(WaitFor([&]() {return trigrams.Update(file);}), "trigram index built");
+    std::vector<std::string> res;
+    Check(trigrams.Search("STATUS", 10, res) and res == std::vector<std::string>({"git status", "Git Status -s"}),
+          "newest different commands containing the text");
+    Check(trigrams.Search("tus -", 10, res) and res == std::vector<std::string>({"Git Status -s"}), "text with a blank");
+    Check(trigrams.Search("xyz", 10, res) and res.empty(), "no match");
+    Check(!trigrams.Search("st", 10, res), "too short for the index");
+    Check(fs::exists(file + ".tri"), "index saved");
+}
+
+
+static bool ItemsInStep(const ShellHistoryClass &history, const std::vector<std::string> &cmds)
+{
+    // Crossline sees the commands through the base class, oldest first
+    const HistoryClass &base = history;
+    if (base.Size() != cmds.size() or history.GetNoHistory() != cmds.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < cmds.size(); i++) {
+        if (base.Get(i) != cmds[i] or base.GetHistoryItem(i)->item != cmds[i] or history.GetItem(i)->item != cmds[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+
+void TestCrosslineItems(const fs::path &dir)
+{
+    // the items Crossline reads follow the history as commands are added,
+    // repeated, read from another shell and loaded again
+    std::string file = (dir / "items.bin").string();
+    const int64_t now = 1750000000;
+    ShellHistoryClass history;
+    history.Load(file);
+    history.Append("ls", "/work", now, true);
+    history.Append("make", "/work", now+1, true);
+    history.Append("git status", "/other", now+2, true);
+    Check(ItemsInStep(history, {"ls", "make", "git status"}), "items after appends");
+    history.Append("ls", "/other", now+3, true);
+    Check(ItemsInStep(history, {"make", "git status", "ls"}), "repeated command moves to the end");
+
+    ShellHistoryClass other;
+    other.Load(file);
+    Check(ItemsInStep(other, {"make", "git status", "ls"}), "items after loading");
+    other.Append("make", "/work", now+4, true);
+    other.Append("cargo build", "/work", now+5, true);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    history.Sync();
+    Check(ItemsInStep(history, {"git status", "ls", "make", "cargo build"}), "items after reading another shell's");
+}
+
+
+int main(int argc, char const *argv[])
+{
+    fs::path dir = fs::temp_directory_path() / ("crabtest_" + std::to_string(
+                   std::chrono::steady_clock::now().time_since_epoch().count()));
+    fs::create_directories(dir);
+    // commands are also completed from the current folder
+    std::string cwd = Utilities::GetCurrentDirectory();
+    Utilities::SetCurrentDirectory(dir.string());
+
+    std::vector<std::pair<std::string, std::function<void()>>> tests = {
+        {"lock", [&]() {TestLock(dir);}},
+        {"locked append", [&]() {TestLockedAppend(dir);}},
+        {"variables", [&]() {TestVariables();}},
+        {"folder cache", [&]() {TestFolderCache(dir);}},
+        {"cancel", [&]() {TestCancel(dir);}},
+        {"path", [&]() {TestPath(dir);}},
+        {"routing", [&]() {TestRouting(dir);}},
+        {"compact frecency", [&]() {TestCompactFrecency(dir);}},
+        {"crossline items", [&]() {TestCrosslineItems(dir);}},
+        {"hint worker", [&]() {TestHintWorker(dir);}},
+        {"file records", [&]() {TestFileRecords(dir);}},
+        {"list dedup", [&]() {TestListDedup();}},
+        {"trie best", [&]() {TestTrieBest();}},
+        {"tail sync", [&]() {TestTailSync(dir);}},
+        {"shards", [&]() {TestShards(dir);}},
+        {"next table", [&]() {TestNextTable(dir);}},
+        {"search", [&]() {TestSearch(dir);}},
+    };
+    for (const auto &test : tests) {
+        if (argc > 1 and test.first != argv[1]) {
+            continue;
+        }
+        int failed = noFailed;
+        test.second();
+        std::cout << (noFailed == failed ? "ok     " : "FAILED ") << test.first << "\n";
+    }
+
+    Utilities::SetCurrentDirectory(cwd);
+    std::error_code ec;
+    fs::remove_all(dir, ec);
+    return noFailed == 0 ? 0 : 1;
+}
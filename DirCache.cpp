@@ -0,0 +1,262 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2024, John Burnell
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  DirCache.cpp
+  Sorted listings of the folders completed in, kept until they change
+-----------------------------------------------------------------------------*/
+
+#include <algorithm>
+#include <cctype>
+
+#include <filesystem>
+namespace fs = std::filesystem;
+
+#ifdef __linux__
+# include <unistd.h>
+# include <sys/inotify.h>
+#endif
+
+#include "DirCache.h"
+#include "Utilities.h"
+
+
+#ifdef __linux__
+static const uint32_t watchMask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF |
+                                  IN_MOVE_SELF | IN_ONLYDIR;
+#endif
+
+
+DirCacheClass &DirCacheClass::Get()
+{
+    static DirCacheClass instance;
+    return instance;
+}
+
+
+DirCacheClass::DirCacheClass()
+{
+    memUsed = 0;
+    memLimit = 16*1024*1024;
+    ignoreCase = Utilities::IsWindows();
+#ifdef __linux__
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+}
+
+
+DirCacheClass::~DirCacheClass()
+{
+    Clear();
+#ifdef __linux__
+    if (fd >= 0) {
+        close(fd);
+    }
+#endif
+}
+
+
+void DirCacheClass::SetLimit(const size_t limit)
+{
+    memLimit = limit;
+    while (!lru.empty() and memUsed > memLimit) {
+        Drop(lru.back());
+    }
+}
+
+
+void DirCacheClass::Clear()
+{
+    while (!lru.empty()) {
+        Drop(lru.back());
+    }
+}
+
+
+void DirCacheClass::Drop(const std::string &folder)
+{
+    auto it = listings.find(folder);
+    if (it == listings.end()) {
+        return;
+    }
+#ifdef __linux__
+    Unwatch(it->second.wd, folder);
+#endif
+    memUsed -= it->second.mem;
+    lru.erase(it->second.lru);
+    listings.erase(it);
+}
+
+
+#ifdef __linux__
+void DirCacheClass::ReadEvents()
+{
+    // drop the listings of the folders changed, a read never blocks
+    if (fd < 0) {
+        return;
+    }
+    alignas(struct inotify_event) char buf[4096];
+    ssize_t len;
+    while ((len = read(fd, buf, sizeof(buf))) > 0) {
+        for (char *p = buf; p < buf + len; ) {
+            struct inotify_event *ev = reinterpret_cast<struct inotify_event*>(p);
+            if (ev->mask & IN_Q_OVERFLOW) {
+                Clear();
+            } else {
+                auto it = watches.find(ev->wd);
+                if (it != watches.end()) {
+                    std::vector<std::string> folders = it->second;
+                    for (const std::string &folder : folders) {
+                        Drop(folder);
+                    }
+                }
+            }
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+}
+
+
+void DirCacheClass::Unwatch(const int wd, const std::string &folder)
+{
+    // the watch is removed with the last listing using it
+    auto it = watches.find(wd);
+    if (it == watches.end()) {
+        return;
+    }
+    auto &folders = it->second;
+    auto f = std::find(folders.begin(), folders.end(), folder);
+    if (f != folders.end()) {
+        folders.erase(f);
+    }
+    if (folders.empty()) {
+        inotify_rm_watch(fd, wd);
+        watches.erase(it);
+    }
+}
+#endif
+
+
+bool DirCacheClass::Less(const std::string &a, const std::string &b) const
+{
+    if (!ignoreCase) {
+        return a < b;
+    }
+    return std::lexicographical_compare(a.begin(), a.end(), b.begin(), b.end(), [](const char x, const char y) {
+        return std::tolower(uint8_t(x)) < std::tolower(uint8_t(y));
+    });
+}
+
+
+bool DirCacheClass::List(const std::string &folder, Listing &listing, const std::function<bool()> &stop)
+{
+    // the watch is added first, so a change while listing is seen
+#ifdef __linux__
+    listing.wd = fd >= 0 ? inotify_add_watch(fd, folder.c_str(), watchMask) : -1;
+    if (listing.wd >= 0) {
+        watches[listing.wd].push_back(folder);
+    }
+#else
+    std::error_code ec;
+    listing.modTime = fs::last_write_time(folder, ec).time_since_epoch().count();
+#endif
+    listing.mem = sizeof(Listing) + 2*folder.size();
+    bool stopped = false;
+    bool ok = Utilities::ScanFolder(folder, [&](const std::string_view &name, const bool isDir) {
+        // a large folder can take a while, so stop is checked as it is read
+        if (stop and listing.entries.size() % 1024 == 1023 and stop()) {
+            stopped = true;
+            return false;
+        }
+        listing.entries.push_back({std::string(name), isDir});
+        listing.mem += sizeof(Entry) + listing.entries.back().name.capacity();
+        return true;
+    });
+    if (!ok or stopped) {
+        return false;
+    }
+    std::sort(listing.entries.begin(), listing.entries.end(), [this](const Entry &a, const Entry &b) {
+        return Less(a.name, b.name);
+    });
+    return true;
+}
+
+
+bool DirCacheClass::Find(const std::string &folder, const std::string &pref,
+                         const std::function<bool(const Entry &ent)> &found, const std::function<bool()> &stop)
+{
+    std::error_code ec;
+    std::string key = fs::absolute(fs::path(folder), ec).lexically_normal().string();
+    if (ec) {
+        return false;
+    }
+    if (key.size() > 1 and (key.back() == '/' or key.back() == Utilities::pathSep)) {
+        key.pop_back();
+    }
+
+#ifdef __linux__
+    ReadEvents();
+#endif
+    auto it = listings.find(key);
+#ifndef __linux__
+    if (it != listings.end() and
+        fs::last_write_time(key, ec).time_since_epoch().count() != it->second.modTime) {
+        Drop(key);
+        it = listings.end();
+    }
+#endif
+
+    Listing fresh;
+    const Listing *listing = &fresh;
+    if (it != listings.end()) {
+        lru.splice(lru.begin(), lru, it->second.lru);
+        listing = &it->second;
+    } else {
+        if (!List(key, fresh, stop)) {
+#ifdef __linux__
+            Unwatch(fresh.wd, key);
+#endif
+            return false;
+        }
+#ifdef __linux__
+        bool watched = fresh.wd >= 0;
+#else
+        bool watched = true;
+#endif
+        if (watched and fresh.mem <= memLimit) {
+            lru.push_front(key);
+            fresh.lru = lru.begin();
+            memUsed += fresh.mem;
+            Listing &kept = listings[key];
+            kept = std::move(fresh);
+            listing = &kept;
+            while (lru.size() > 1 and (memUsed > memLimit or lru.size() > maxListings)) {
+                Drop(lru.back());
+            }
+        } else {
+#ifdef __linux__
+            // too large to keep
+            Unwatch(fresh.wd, key);
+#endif
+        }
+    }
+
+    // the entries starting with pref are together
+    const auto &entries = listing->entries;
+    auto first = std::lower_bound(entries.begin(), entries.end(), pref, [this](const Entry &e, const std::string &p) {
+        return Less(e.name, p);
+    });
+    // found may pass over most of them, so stop is checked as they are walked
+    size_t noWalked = 0;
+    for (auto e = first; e != entries.end() and Utilities::StartsWith(e->name, pref, ignoreCase); e++) {
+        if (stop and ++noWalked % 256 == 0 and stop()) {
+            return false;
+        }
+        if (!found(*e)) {
+            break;
+        }
+    }
+    return true;
+}
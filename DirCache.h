@@ -0,0 +1,86 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2024, John Burnell
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  DirCache.h
+  Sorted listings of the folders completed in, kept until they change
+-----------------------------------------------------------------------------*/
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Utilities.h"
+
+
+class DirCacheClass {
+    // A folder is listed once and its entries sorted by name, so completing
+    // in it again is a binary search. On Linux a listing is dropped when an
+    // inotify watch on its folder reports an entry added, removed or renamed,
+    // elsewhere when the folder's modification time changes. The least
+    // recently used listings are dropped to keep within the memory limit.
+    // Only used by the input thread.
+public:
+    using Entry = Utilities::FolderEntry;
+
+    static constexpr size_t maxListings = 256;    // each has a watch
+
+protected:
+    struct Listing {
+        std::vector<Entry> entries;
+        std::list<std::string>::iterator lru;
+        size_t mem;
+#ifdef __linux__
+        int wd;
+#else
+        int64_t modTime;
+#endif
+    };
+    std::unordered_map<std::string, Listing> listings;
+    std::list<std::string> lru;                     // most recent first
+    size_t memUsed;
+    size_t memLimit;
+    bool ignoreCase;
+#ifdef __linux__
+    int fd;
+    // wd -> the folders listed through it, one folder reached by two paths
+    // has one watch
+    std::unordered_map<int, std::vector<std::string>> watches;
+
+    void ReadEvents();
+    void Unwatch(const int wd, const std::string &folder);
+#endif
+
+    DirCacheClass();
+    ~DirCacheClass();
+
+    void Drop(const std::string &folder);
+    bool Less(const std::string &a, const std::string &b) const;
+    bool List(const std::string &folder, Listing &listing, const std::function<bool()> &stop);
+
+public:
+    DirCacheClass(const DirCacheClass&) = delete;
+    void operator=(const DirCacheClass&) = delete;
+
+    static DirCacheClass &Get();
+
+    // bytes the listings can use, 0 to not cache
+    void SetLimit(const size_t limit);
+    void Clear();
+
+    // Call found with the entries of folder starting with pref (ignoring case
+    // on Windows) in name order, until it returns false. stop is checked while
+    // the folder is read and its entries walked, and ends it if it returns
+    // true. False if the folder cannot be read or was stopped
+    bool Find(const std::string &folder, const std::string &pref, const std::function<bool(const Entry &ent)> &found,
+              const std::function<bool()> &stop=nullptr);
+
+    size_t MemoryUsage() const {return memUsed;}
+};
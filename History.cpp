@@ -21,9 +21,13 @@ using namespace std::chrono_literals;
 namespace fs = std::filesystem;
 
 #include <ctime>
+#include <sstream>
+#include <thread>
+#include <atomic>
 
 #include "History.h"
 #include "Utilities.h"
+#include "HistoryText.h"
 
 
 CrabHistoryItem::CrabHistoryItem(const std::string &c, const std::string &d, const std::string &f)
@@ -43,194 +47,812 @@ std::ostream& operator<<(std::ostream &out, const CrabHistoryItem& item)
 
 ShellHistoryClass::ShellHistoryClass() : HistoryClass()
 {
+    SetLoadThreads(0);
+    SetWindow(0, 0, 0);
+    SetShards(0);
+    halfLife = 72.0;
+    ClearData();
 }
 
 
-bool ShellHistoryClass::Load(const std::string &inFile)
+ShellHistoryClass::~ShellHistoryClass()
 {
-    fileName = inFile;
+    WriteUnwritten(true);
+}
 
-    if (not Utilities::FileExists(inFile)) {
-        std::ofstream ofs(inFile);
-        if (ofs) {
-            ofs << "History:\n";
+
+void ShellHistoryClass::SetLoadThreads(const int n)
+{
+    loadThreads = n > 0 ? n : std::max(1U, std::thread::hardware_concurrency());
+}
+
+
+void ShellHistoryClass::SetHalfLife(const double hours)
+{
+    halfLife = hours;
+    index->frecency.SetHalfLife(hours);
+}
+
+
+void ShellHistoryClass::SetWindow(const size_t noItems, const size_t noFolderItems, const size_t limit)
+{
+    hotItems = noItems;
+    folderItems = noFolderItems;
+    memLimit = limit;
+}
+
+
+void ShellHistoryClass::SetShards(const size_t n)
+{
+    noShards = n;
+}
+
+
+void ShellHistoryClass::Clear()
+{
+    if (writer) {
+        writer->Stop();
+    }
+    WriteUnwritten(true);
+    watch.Close();
+    usedFolders.clear();
+    trigrams.Clear();
+    {
+        std::lock_guard<std::mutex> lck(nextMutex);
+        next.Clear();
+    }
+    shards.Clear();
+    ClearData();
+}
+
+
+void ShellHistoryClass::ClearData()
+{
+    HistoryClass::Clear();
+    syncOffset = 0;
+    fileId = 0;
+    replaced = false;
+    ownRecords.clear();
+    order.Clear();
+    folderMap.assign(1, HistoryListClass());
+    folderTree.Clear();
+    fuzzy.Clear();
+    fuzzyBuilt = false;
+    windowStart = 0;
+    oldLoaded.clear();
+    // a hint thread may still be reading the old index, it goes once it is done
+    if (index) {
+        index->cold.Cancel();
+    }
+    index = std::make_shared<HistoryIndexClass>();
+    index->frecency.SetHalfLife(halfLife);
+}
+
+
+void ShellHistoryClass::StartWriter(const HistoryWriterClass::Durability dur, const int intervalMS, const int batch)
+{
+    if (fileName.empty()) {
+        return;
+    }
+    if (!writer) {
+        writer = std::make_unique<HistoryWriterClass>();
+    }
+    writer->Start(fileName, dur, intervalMS, batch);
+}
+
+
+void ShellHistoryClass::Flush()
+{
+    if (writer) {
+        writer->Flush();
+    }
+    WriteUnwritten(false);
+}
+
+
+void ShellHistoryClass::WriteUnwritten(const bool force)
+{
+    // appends are single O_APPEND writes, the shared lock only keeps them out
+    // of the way of a rewrite of the file, which would lose them. While a
+    // rewrite has the lock they are kept here, unless they would be lost
+    if (unwritten.empty() or fileName.empty()) {
+        return;
+    }
+    Utilities::FileLock lck(fileName, true);
+    if (lck.HasLock() or force) {
+        HistoryFileClass::AppendData(fileName, unwritten);
+        unwritten.clear();
+    }
+}
+
+
+bool ShellHistoryClass::Compact(const HistoryRetention &keep)
+{
+    if (fileName.empty()) {
+        return false;
+    }
+    // queued commands can be written while compacting, they are added under the lock
+    Flush();
+    HistoryRetention withDecay = keep;
+    withDecay.halfLife = halfLife;
+    return compactor.Start(fileName, withDecay);
+}
+
+
+bool ShellHistoryClass::CompactResult(std::string &msg)
+{
+    return compactor.GetResult(msg);
+}
+
+
+double ShellHistoryClass::DuplicateRatio() const
+{
+    if (index->store.Size() == 0) {
+        return 0.0;
+    }
+    size_t noUnique = 0;
+    for (const auto &list : folderMap) {
+        noUnique += list.Size();
+    }
+    return 1.0 - double(noUnique) / index->store.Size();
+}
+
+
+bool ShellHistoryClass::ImportText(const std::string &textFile, const std::string &binFile)
+{
+    // convert the original yaml history file to the binary format
+    Utilities::MappedFile text;
+    if (!text.Open(textFile)) {
+        return false;
+    }
+    std::vector<HistoryFileClass::Record> recs;
+    HistoryTextParserClass parser;
+    if (!parser.Parse(text.Data(), text.Size(), recs)) {
+        return false;
+    }
+
+    std::ostringstream msg;
+    msg << "Converting " << textFile << " with " << recs.size() << " items to " << binFile;
+    Utilities::LogMessage(msg.str());
+
+    return HistoryFileClass::Write(binFile, recs);
+}
+
+
+uint32_t ShellHistoryClass::AddEntry(const std::string_view &cmd, const std::string_view &folder, 
+                                     const int64_t time, const uint32_t flags, const float weight)
+{
+    // Duplicates collapse to the newest, globally and in the folder. Each
+    // part of the index is written before the tries publish the entry
+    HistoryStoreClass &store = index->store;
+    HistoryFrecencyClass &frecency = index->frecency;
+    uint32_t folderId = store.InternFolder(folder);
+    if (folderId >= folderMap.size()) {
+        AddFolders(folderMap.size());
+    }
+    uint32_t ind = store.Add(cmd, time, folderId);
+    frecency.Resize(ind+1);
+    std::string_view cmdView = store.Cmd(ind);
+    uint32_t old = order.Add(cmdView, ind);
+    if (fuzzyBuilt) {
+        if (old != HistoryListClass::noEntry) {
+            fuzzy.Remove(old);
         }
-        ofs.close();
-    }
-
-    // load the history from a yaml file. The format is simple so just use a custom parser
-    std::ifstream inp(inFile);
-    // search start - "History:"
-    bool found = false;
-    for (std::string line; std::getline(inp, line);) {
-        Utilities::StripStringEnd(line);
-        if (line == "History:") {
-            found = true;
-            break;
+        fuzzy.Add(cmdView, ind);
+    }
+    uint32_t oldInFolder = folderMap[folderId].Add(cmdView, ind);
+
+    // the scores carry on from the command's previous entries
+    float score = frecency.Use(frecency.Global(old), time, flags, weight);
+    float folderScore = frecency.Use(frecency.Folder(oldInFolder), time, flags, weight);
+    frecency.SetGlobal(ind, score);
+    frecency.SetFolder(ind, folderScore);
+    index->allTrie.Insert(cmdView, ind, score);
+    if (folderId > 0) {
+        index->folderTries[folderId].Insert(cmdView, ind, folderScore);
+    }
+    return ind;
+}
+
+
+void ShellHistoryClass::AddNewest(const std::string_view &cmd, const std::string_view &folder,
+                                  const int64_t time, const uint32_t flags, const float weight)
+{
+    // as AddEntry, with the command's item moved to the end
+    uint32_t pos = order.Position(cmd);
+    if (pos != HistoryListClass::noEntry and pos < items.size()) {
+        items.erase(items.begin() + pos);
+    }
+    uint32_t ind = AddEntry(cmd, folder, time, flags, weight);
+    HistoryClass::Add(MakeItem(ind));
+}
+
+
+void ShellHistoryClass::RebuildItems()
+{
+    // after the commands have been added together
+    std::vector<uint32_t> ents;
+    order.GetEntries(ents);
+    HistoryClass::Clear();
+    items.reserve(ents.size());
+    for (uint32_t ind : ents) {
+        HistoryClass::Add(MakeItem(ind));
+    }
+}
+
+
+void ShellHistoryClass::AddFolders(const uint32_t first)
+{
+    // the folders interned from first on
+    size_t noFolders = index->store.NoFolders();
+    folderMap.resize(noFolders);
+    index->folderTries.Resize(noFolders);
+    for (uint32_t id = std::max(first, 1U); id < noFolders; id++) {
+        folderTree.Add(index->store.FolderName(id), id);
+    }
+}
+
+
+bool ShellHistoryClass::GetHint(const std::string &pref, const std::string &folder, std::string &hint) const
+{
+    std::vector<HistoryFolderTreeClass::Ancestor> folders;
+    FindFolders(folder, folders);
+    return index->FindHint(pref, folders, hint);
+}
+
+
+void ShellHistoryClass::FindFolders(const std::string &folder, 
+                                    std::vector<HistoryFolderTreeClass::Ancestor> &folders) const
+{
+    folderTree.Ancestors(folder, folders);
+}
+
+
+double ShellHistoryClass::GetFrecency(const std::string &cmd, const std::string &folder, const int64_t now) const
+{
+    if (folder.empty()) {
+        return index->frecency.Current(index->frecency.Global(order.Find(cmd)), now);
+    }
+    uint32_t folderId = index->store.FindFolder(folder);
+    if (folderId == HistoryStoreClass::noFolder) {
+        return 0.0;
+    }
+    return index->frecency.Current(index->frecency.Folder(folderMap[folderId].Find(cmd)), now);
+}
+
+
+void ShellHistoryClass::AddRecords(const std::vector<HistoryFileClass::Record> &recs)
+{
+    // The same as AddEntry for each record. The store columns are filled in
+    // order, then the global list and trie and the per folder lists and tries
+    // only depend on their own entries so are built in parallel. A trie needs
+    // the frecency from its list, so each is built with its list.
+    if (loadThreads < 2 or recs.size() < 64*1024) {
+        for (const auto &rec : recs) {
+            AddEntry(rec.cmd, rec.folder, rec.time, rec.flags, rec.weight);
         }
+        return;
     }
 
-    if (!found) {
-        return false;
+    HistoryStoreClass &store = index->store;
+    HistoryFrecencyClass &frecency = index->frecency;
+    uint32_t first = store.Size();
+    std::vector<size_t> folderCounts;
+    for (const auto &rec : recs) {
+        uint32_t folderId = store.InternFolder(rec.folder);
+        if (folderId >= folderCounts.size()) {
+            folderCounts.resize(folderId+1);
+        }
+        folderCounts[folderId]++;
+        store.Add(rec.cmd, rec.time, folderId);
+    }
+    uint32_t last = store.Size();
+    frecency.Resize(last);
+    if (folderMap.size() < store.NoFolders()) {
+        AddFolders(folderMap.size());
     }
 
-    std::string keys[] = {"- Cmd: ", "Date: ", "Folder: "};
-    std::string entries[3];
-    std::string line;
-    while (std::getline(inp, line)) {
-        // 3 records - Cmd, Date, Folder
-        Utilities::StripStringEnd(line);
-        if (line.find(keys[0]) != line.npos) {
-            // have found record
-            for (int i = 0; i < 3; i++) {
-                int pos = line.find(keys[i]);
-                if (pos != line.npos) {
-                     std::string st = line.substr(pos+keys[i].size());
-                     // remove quotes in yaml file
-                     if (st.find("'") == 0) {
-                        st.erase(0, 1);
-                        // find last
-                        int pos1 = st.find("'");
-                        if (pos1 != st.npos) {
-                            st.erase(pos1, 1);
-                        }
-                     }
-                     entries[i] = st;
-                }
-                if (i < 2 and !std::getline(inp, line)) {
-                    return Size() > 0;
+    std::vector<std::function<void()>> tasks;
+    tasks.push_back([this, &store, &frecency, first, last, &recs]() {
+        for (uint32_t ind = first; ind < last; ind++) {
+            std::string_view cmd = store.Cmd(ind);
+            uint32_t old = order.Add(cmd, ind);
+            float score = frecency.Use(frecency.Global(old), store.Time(ind), recs[ind-first].flags,
+                                           recs[ind-first].weight);
+            frecency.SetGlobal(ind, score);
+            index->allTrie.Insert(cmd, ind, score);
+        }
+    });
+
+    // share the folders between groups with about the same number of entries
+    const int noGroups = loadThreads;
+    std::vector<uint32_t> folders(folderCounts.size());
+    for (uint32_t id = 0; id < folders.size(); id++) {
+        folders[id] = id;
+    }
+    std::sort(folders.begin(), folders.end(), [&folderCounts](const uint32_t a, const uint32_t b) {
+        return folderCounts[a] > folderCounts[b];
+    });
+    std::vector<int> group(folderCounts.size());
+    std::vector<size_t> groupCounts(noGroups);
+    for (uint32_t id : folders) {
+        group[id] = std::min_element(groupCounts.begin(), groupCounts.end()) - groupCounts.begin();
+        groupCounts[group[id]] += folderCounts[id];
+    }
+    for (int g = 0; g < noGroups; g++) {
+        tasks.push_back([this, &store, &frecency, first, last, g, &group, &recs]() {
+            for (uint32_t ind = first; ind < last; ind++) {
+                uint32_t folderId = store.FolderId(ind);
+                if (folderId < group.size() and group[folderId] == g) {
+                    std::string_view cmd = store.Cmd(ind);
+                    uint32_t old = folderMap[folderId].Add(cmd, ind);
+                    float score = frecency.Use(frecency.Folder(old), store.Time(ind), recs[ind-first].flags,
+                                                   recs[ind-first].weight);
+                    frecency.SetFolder(ind, score);
+                    if (folderId > 0) {
+                        index->folderTries[folderId].Insert(cmd, ind, score);
+                    }
                 }
             }
-            CrabHistoryItemPtr item = std::make_shared<CrabHistoryItem>(entries[0], entries[1], entries[2]);
-            Add(item);
-            // historyMap[entries[0]] = item;
-            if (entries[2].size() > 0) {
-                folderMap[entries[2]].push_back(item);
-            } else {
-                noFolderMap.push_back(item);
+        });
+    }
+    Utilities::RunTasks(tasks, loadThreads);
+}
+
+
+bool ShellHistoryClass::Load(const std::string &inFile)
+{
+    fileName = inFile;
+
+    if (not Utilities::FileExists(inFile)) {
+        Utilities::FileLock lck(inFile);
+        if (not Utilities::FileExists(inFile)) {
+            // convert an old text history if there is one
+            fs::path textFile = fs::path(inFile).replace_extension(".dat");
+            if (not (Utilities::FileExists(textFile.string()) and ImportText(textFile.string(), inFile))) {
+                HistoryFileClass::Create(inFile);
             }
         }
     }
 
+    if (!index->file.Open(inFile)) {
+        Utilities::LogError("Error: cannot read history file " + inFile);
+        return false;
+    }
+
+    // the commands refer directly to the mapped file
+    usedFolders.insert(Utilities::GetCurrentDirectory());
+    std::vector<HistoryFileClass::Record> recs;
+    GetWindowRecords(recs);
+    syncOffset = index->file.ValidEnd();
+    fileId = Utilities::GetFileId(inFile);
+    watch.Open(inFile);
+    index->store.SetMapping(index->file.Data(), index->file.Size());
+    order.Reserve(recs.size() + 1024);
+    AddRecords(recs);
+    RebuildItems();
+    {
+        std::lock_guard<std::mutex> lck(nextMutex);
+        next.Update(inFile);
+    }
+    // the search index is read or built on a thread
+    trigrams.Update(inFile);
+
     std::ostringstream msg;
-    msg << "Read history with " << Size() << " items\n";
+    msg << "Read history with " << GetNoHistory() << " items";
+    if (windowStart > 0) {
+        msg << ", " << windowStart << " older records left in the file";
+    }
     Utilities::LogMessage(msg.str());
 
     return true;
 }
 
 
-typedef std::vector<SearchItemPtr>::iterator HistIter;
-
-// end is index from start
-int ShellHistoryClass::RevFind(const std::string &cmd, const int beg, const int end)
+void ShellHistoryClass::GetWindowRecords(std::vector<HistoryFileClass::Record> &recs)
 {
-    // Search from fin to begin for cmd
-    HistIter start = items.begin() + beg;
-    HistIter fin = items.begin() + end;
-    for (int i = end; i >= beg; i--) {
-        HistoryItemPtr p = MakeItemPtr(items[i]);
-        if (p->item == cmd) {
-            return i;
+    // The window is the newest hotItems indexed records and the tail. The
+    // newest records of the used folders from before it come first, found
+    // from their shards or else the cold segment indices or, at start up, a
+    // limited scan
+    uint64_t noIndexed = index->file.NoIndexed();
+    windowStart = (hotItems > 0 and noIndexed > hotItems) ? noIndexed - hotItems : 0;
+    if (windowStart == 0) {
+        index->file.GetRecords(recs, loadThreads);
+        return;
+    }
+    index->cold.Start(index->file, windowStart, memLimit);
+    bool sharded = shards.Update(fileName, index->file, noShards);
+
+    std::vector<uint64_t> inds, folderInds;
+    for (const auto &folder : usedFolders) {
+        if (sharded) {
+            shards.FolderRecords(index->file, folder, folderItems, windowStart, folderInds);
+        } else {
+            index->cold.FolderRecords(folder, folderItems, 4*hotItems, folderInds);
+        }
+        inds.insert(inds.end(), folderInds.begin(), folderInds.end());
+    }
+    std::sort(inds.begin(), inds.end());
+    oldLoaded = inds;
+    std::vector<HistoryFileClass::Record> window;
+    index->file.GetRecords(window, loadThreads, windowStart);
+
+    recs.reserve(inds.size() + window.size());
+    HistoryFileClass::Record rec;
+    for (uint64_t ind : inds) {
+        if (index->file.DecodeIndexed(ind, rec)) {
+            recs.push_back(rec);
         }
     }
-    return -1;
+    recs.insert(recs.end(), window.begin(), window.end());
 }
 
 
-// constexpr auto t20{20ms};
-void ShellHistoryClass::Append(const std::string &cmd, const std::string &folder, 
-                               const std::string &tm, const bool appendToFile)
+bool ShellHistoryClass::Reload()
 {
-    CrabHistoryItemPtr item = std::make_shared<CrabHistoryItem>(cmd, tm, folder);
+    // everything appended is read back from the file
+    Flush();
+    ClearData();
+    return Load(fileName);
+}
 
-    bool add = true;
-    // remove any old entries in the last 50 
-    int noHis = Size();
-    int noFind = std::min(50, int(noHis));
-    int startInd = noHis - noFind;
 
-    int fin = noHis-1;
-    auto it = RevFind(cmd, startInd, fin);
-    if (it >= 0) {
-        if (it == fin) {
-            add = false;
-        } else {
-            std::ostringstream msg;
-            auto p = MakeItemPtr(items[it]);
-            msg << "Erasing history item " << p->item;
-            Utilities::LogMessage(msg.str());
-            items.erase(items.begin()+it);
+int ShellHistoryClass::Reach(const int n)
+{
+    // older records only come before the loaded ones, so the item moves up
+    // by the number of commands added
+    const int margin = 16;
+    if (windowStart == 0 or n >= margin) {
+        return n;
+    }
+    size_t noItems = order.Size();
+    size_t newHotItems = 2*(index->file.NoIndexed() - windowStart);
+    size_t noEntries = index->store.Size();
+    if (memLimit > 0 and noEntries > 0 and index->store.MemoryUsage() / noEntries * newHotItems > memLimit) {
+        return n;
+    }
+    // the records from the new start are added to those loaded, less any
+    // of the folders' that already are
+    uint64_t noIndexed = index->file.NoIndexed();
+    uint64_t newStart = noIndexed > newHotItems ? noIndexed - newHotItems : 0;
+    std::vector<uint64_t> inds;
+    for (uint64_t i = newStart; i < windowStart; i++) {
+        if (!std::binary_search(oldLoaded.begin(), oldLoaded.end(), i)) {
+            inds.push_back(i);
         }
     }
-    if (add) {
-        Add(item);
-    }
-
-    // Assign to a folder
-    if (folder.size() > 0) {
-        if (folderMap.count(folder) > 0) {
-            // check if already present, just the last 20 entries
-            std::vector<HistoryItemPtr> &foldVec = folderMap[folder];
-            int no = foldVec.size();
-            int start = std::max(0, no-20);
-            bool add = true;
-            for(int i = no-1; i >= start; i--) {
-                if (foldVec[i]->item == cmd) {
-                    if (i == no-1) {
-                        add = false;
-                    } else {
-                        foldVec.erase(foldVec.begin()+i);
-                    }
-                    break;
+    hotItems = newHotItems;
+    windowStart = newStart;
+    oldLoaded.erase(std::lower_bound(oldLoaded.begin(), oldLoaded.end(), newStart), oldLoaded.end());
+    AddOlder(inds);
+    return n + int(order.Size() - noItems);
+}
+
+
+void ShellHistoryClass::AddOlder(const std::vector<uint64_t> &inds)
+{
+    // The records, in file order, are added to the store after the loaded
+    // ones. The scores of each command's uses in them are added to that of
+    // its newest entry, the loaded one or theirs, and the lists are rebuilt
+    // with the commands in order of last use
+    struct Chain {
+        float score;
+        uint32_t newest;
+    };
+    typedef std::unordered_map<std::string_view, Chain> Chains;
+    HistoryStoreClass &store = index->store;
+    HistoryFrecencyClass &frecency = index->frecency;
+    Chains global;
+    std::unordered_map<uint32_t, Chains> inFolder;
+    HistoryFileClass::Record rec;
+    for (uint64_t i : inds) {
+        if (!index->file.DecodeIndexed(i, rec)) {
+            continue;
+        }
+        uint32_t folderId = store.InternFolder(rec.folder);
+        uint32_t ind = store.Add(rec.cmd, rec.time, folderId);
+        frecency.Resize(ind+1);
+        std::string_view cmd = store.Cmd(ind);
+        auto glob = global.insert({cmd, {HistoryFrecencyClass::noScore, ind}}).first;
+        glob->second.score = frecency.Use(glob->second.score, rec.time, rec.flags, rec.weight);
+        glob->second.newest = ind;
+        frecency.SetGlobal(ind, glob->second.score);
+        auto fold = inFolder[folderId].insert({cmd, {HistoryFrecencyClass::noScore, ind}}).first;
+        fold->second.score = frecency.Use(fold->second.score, rec.time, rec.flags, rec.weight);
+        fold->second.newest = ind;
+        frecency.SetFolder(ind, fold->second.score);
+    }
+    if (folderMap.size() < store.NoFolders()) {
+        AddFolders(folderMap.size());
+    }
+
+    auto before = [&store](const uint32_t a, const uint32_t b) {return store.Time(a) < store.Time(b);};
+    auto place = [&store, &frecency, &before](HistoryListClass &list, HistoryTrieClass *trie, const Chains &chains,
+                                              const bool isGlobal) {
+        std::vector<std::pair<std::string_view, uint32_t>> newest;
+        for (const auto &it : chains) {
+            uint32_t ind = it.second.newest;
+            float score = it.second.score;
+            uint32_t old = list.Find(it.first);
+            if (old != HistoryListClass::noEntry) {
+                score = HistoryFrecencyClass::Merge(score, isGlobal ? frecency.Global(old) : frecency.Folder(old));
+                if (!before(old, ind)) {
+                    ind = old;
                 }
             }
+            if (isGlobal) {
+                frecency.SetGlobal(ind, score);
+            } else {
+                frecency.SetFolder(ind, score);
+            }
+            if (trie != nullptr) {
+                trie->Insert(store.Cmd(ind), ind, score);
+            }
+            if (ind != old) {
+                newest.push_back({store.Cmd(ind), ind});
+            }
+        }
+        if (!newest.empty()) {
+            list.AddOlder(newest, before);
         }
-        if (add) {
-            folderMap[folder].push_back(item);
+    };
+    place(order, &index->allTrie, global, true);
+    for (const auto &it : inFolder) {
+        place(folderMap[it.first], it.first > 0 ? &index->folderTries[it.first] : nullptr, it.second, false);
+    }
+    if (fuzzyBuilt) {
+        fuzzy.Clear();
+        fuzzyBuilt = false;
+    }
+    RebuildItems();
+
+    // those before the window are remembered so they are not added again
+    std::vector<uint64_t> old;
+    for (uint64_t i : inds) {
+        if (i < windowStart) {
+            old.push_back(i);
         }
+    }
+    size_t mid = oldLoaded.size();
+    oldLoaded.insert(oldLoaded.end(), old.begin(), old.end());
+    std::inplace_merge(oldLoaded.begin(), oldLoaded.begin() + mid, oldLoaded.end());
+}
+
+
+void ShellHistoryClass::UseFolder(const std::string &folder)
+{
+    if (!usedFolders.insert(folder).second or windowStart == 0 or folderItems == 0) {
+        return;
+    }
+    // the folder's newest older records are added to those loaded, from its
+    // shard once the shards have been built
+    std::vector<uint64_t> inds;
+    if (shards.Update(fileName, index->file, noShards)) {
+        shards.FolderRecords(index->file, folder, folderItems, windowStart, inds);
     } else {
-        // this shouldn't be called here
-        noFolderMap.push_back(item);
+        index->cold.FolderRecords(folder, folderItems, 4*hotItems, inds);
+    }
+    inds.erase(std::remove_if(inds.begin(), inds.end(), [this](const uint64_t i) {
+        return i >= windowStart or std::binary_search(oldLoaded.begin(), oldLoaded.end(), i);
+    }), inds.end());
+    if (!inds.empty()) {
+        AddOlder(inds);
+    }
+}
+
+
+std::string ShellHistoryClass::RecordKey(const int64_t time, const std::string_view &folder, 
+                                         const std::string_view &cmd)
+{
+    std::string key = std::to_string(time);
+    key += '\n';
+    key += folder;
+    key += '\n';
+    key += cmd;
+    return key;
+}
+
+
+bool ShellHistoryClass::Sync()
+{
+    if (fileName.empty() or replaced or !watch.Changed()) {
+        return false;
+    }
+    return ReadTail();
+}
+
+
+bool ShellHistoryClass::Refresh()
+{
+    if (next.Ready()) {
+        // take up the next token table built in the background, with this
+        // shell's commands written so they are counted from the file
+        Flush();
+        std::lock_guard<std::mutex> lck(nextMutex);
+        next.Update(fileName);
+    }
+    if (replaced) {
+        // usually by a compaction. Commands still queued for writing are
+        // read back when they are written
+        Utilities::LogMessage("History file replaced, reloading " + fileName);
+        return Reload();
     }
+    return Sync();
+}
+
+
+bool ShellHistoryClass::ReadTail()
+{
+    // only the part of the file after the last record read is looked at
+    std::string buf;
+    uint64_t id;
+    if (!Utilities::ReadFileTail(fileName, syncOffset, buf, id)) {
+        return false;
+    }
+    if (id != fileId) {
+        // replaced, read again by Refresh
+        replaced = true;
+        return false;
+    }
+
+    std::vector<HistoryFileClass::Record> recs;
+    syncOffset += HistoryFileClass::Scan(buf.data(), buf.size(), 0, recs);
+    int noNew = 0;
+    for (const auto &rec : recs) {
+        auto own = ownRecords.find(RecordKey(rec.time, rec.folder, rec.cmd));
+        if (own != ownRecords.end()) {
+            ownRecords.erase(own);
+            continue;
+        }
+        AddNewest(rec.cmd, rec.folder, rec.time, rec.flags, rec.weight);
+        std::lock_guard<std::mutex> lck(nextMutex);
+        next.Add(rec.cmd, rec.folder, rec.flags);
+        noNew++;
+    }
+    if (noNew > 0) {
+        Utilities::LogMessage("Read " + std::to_string(noNew) + " history items from other shells");
+    }
+    return noNew > 0;
+}
+
+
+HistoryItemPtr ShellHistoryClass::MakeItem(const uint32_t ind) const
+{
+    const HistoryStoreClass &store = index->store;
+    return std::make_shared<CrabHistoryItem>(std::string(store.Cmd(ind)), Utilities::FormatTime(store.Time(ind)),
+                                             std::string(store.Folder(ind)));
+}
+
+
+HistoryItemPtr ShellHistoryClass::GetItem(const int n) const
+{
+    if (n < 0 or n >= int(items.size())) {
+        return std::make_shared<CrabHistoryItem>("", "", "");
+    }
+    return HistoryClass::GetHistoryItem(n);
+}
+
+
+// constexpr auto t20{20ms};
+void ShellHistoryClass::Append(const std::string &cmd, const std::string &folder, 
+                               const int64_t tm, const bool appendToFile, const bool success)
+{
+    // a repeat of the last command is not written again
+    uint32_t last = order.Last();
+    bool add = last == HistoryListClass::noEntry or index->store.Cmd(last) != cmd;
+
+    // any earlier use of the command, globally and in the folder, moves to the
+    // end and its frecency is carried on
+    uint32_t flags = success ? 0 : HistoryFileClass::failedFlag;
+    AddNewest(cmd, folder, tm, flags);
 
     if (appendToFile and add) {
-        if (fileName.length() > 0) {
-            // write a lock file to prevent other instances from writing
+        // so it is not added again when read back from the file
+        ownRecords.insert(RecordKey(tm, folder, cmd));
+        {
+            std::lock_guard<std::mutex> lck(nextMutex);
+            next.Add(cmd, folder, flags);
+        }
+        if (writer and writer->IsRunning()) {
+            // written in the background, grouped with other commands
+            writer->Push({tm, flags, cmd, folder});
+        } else if (fileName.length() > 0) {
+            // written with any kept while the file was being rewritten
+            HistoryFileClass::EncodeRecord({tm, flags, cmd, folder}, unwritten);
+            WriteUnwritten(false);
+        }
+    }
+}
 
-            Utilities::FileLock lck(fileName);
-            if (lck.HasLock()) {
 
-                std::ofstream ofs(fileName, std::ios::app);
-                if (ofs) {
-                    ofs << "- Cmd: " << cmd << "\n";
-                    ofs << "  Date: '" << tm << "'\n";
-                    ofs << "  Folder: " << folder << "\n";
-                }
-                ofs.close();
-            }
+void ShellHistoryClass::FuzzySearch(const std::string &query, const size_t max, std::vector<HistoryEntry> &res)
+{
+    if (!fuzzyBuilt) {
+        // the list has the commands oldest first
+        std::vector<uint32_t> ents;
+        order.GetEntries(ents);
+        fuzzy.SetThreads(loadThreads);
+        for (uint32_t ent : ents) {
+            fuzzy.Add(index->store.Cmd(ent), ent);
+        }
+        fuzzyBuilt = true;
+    }
+
+    std::vector<HistoryFuzzyClass::Match> matches;
+    fuzzy.Search(query, max, matches);
+    res.clear();
+    for (const auto &m : matches) {
+        res.push_back(index->store.Get(m.entry));
+    }
+}
+
+
+void ShellHistoryClass::SubstringSearch(const std::string &text, const size_t max, std::vector<std::string> &res)
+{
+    // the trigram index covers the file, so write any queued commands first
+    res.clear();
+    if (!fileName.empty()) {
+        Flush();
+        if (trigrams.Update(fileName) and trigrams.Search(text, max, res)) {
+            return;
+        }
+    }
+
+    // too short for the index or it is still being built, look through the
+    // loaded commands
+    std::string folded = Utilities::ToLower(text);
+    HistoryView view = GetItems();
+    for (auto it = view.rbegin(); it != view.rend() and res.size() < max; it++) {
+        if (Utilities::ToLower(std::string(it->cmd)).find(folded) != std::string::npos) {
+            res.emplace_back(it->cmd);
         }
     }
 }
 
 
-std::vector<HistoryItemPtr> ShellHistoryClass::GetFolderItems(const std::string &folder)
+bool ShellHistoryClass::PredictNext(const std::string &line, const std::string &folder, const size_t max,
+                                    std::vector<std::string> &res, size_t &start) const
+{
+    std::lock_guard<std::mutex> lck(nextMutex);
+    return next.Predict(line, folder, max, res, start);
+}
+
+
+HistoryView ShellHistoryClass::GetItems() const
+{
+    return HistoryView(index->store, order);
+}
+
+
+HistoryView ShellHistoryClass::GetFolderItems(const std::string &folder) const
 {
-    std::string st;
-    for (auto it : folderMap) {
-        st = it.first; 
+    uint32_t folderId = index->store.FindFolder(folder);
+    if (folderId != HistoryStoreClass::noFolder) {
+        return HistoryView(index->store, folderMap[folderId]);
     }
-    auto item = folderMap.find(folder);
-    if (item != folderMap.end()) {
-        return item->second;
+    return HistoryView();
+}
+
+
+HistoryView ShellHistoryClass::GetNearestFolderItems(const std::string &folder, int &distance) const
+{
+    std::vector<HistoryFolderTreeClass::Ancestor> folders;
+    folderTree.Ancestors(folder, folders);
+    for (const auto &anc : folders) {
+        if (folderMap[anc.folderId].Size() > 0) {
+            distance = anc.distance;
+            return HistoryView(index->store, folderMap[anc.folderId]);
+        }
     }
-    return std::vector<HistoryItemPtr>();
+    distance = -1;
+    return HistoryView();
 }
 
 
-const std::vector<HistoryItemPtr> &ShellHistoryClass::GetNoFolderItems() 
+HistoryView ShellHistoryClass::GetNoFolderItems() const
 {
-    return noFolderMap;
+    return HistoryView(index->store, folderMap[0]);
 }
 
 
@@ -239,10 +861,21 @@ const std::vector<HistoryItemPtr> &ShellHistoryClass::GetNoFolderItems()
 int main(int argc, char const *argv[])
 {
     if (argc < 2) {
-        std::cout << "Usage: History history_file\n";
+        std::cout << "Usage: History history_file [prefix]\n";
+        std::cout << "       History -compact history_file [max_items] [max_days]\n";
         return 0;
     }
 
+    if (std::string(argv[1]) == "-compact" and argc > 2) {
+        HistoryRetention keep;
+        keep.maxEntries = argc > 3 ? std::stoi(argv[3]) : 0;
+        keep.maxDays = argc > 4 ? std::stoi(argv[4]) : 0;
+        std::string msg;
+        bool ok = HistoryCompactorClass::Compact(argv[2], keep, msg);
+        std::cout << msg << "\n";
+        return ok ? 0 : 1;
+    }
+
     ShellHistoryClass history;
     history.Load(argv[1]);
 
@@ -250,7 +883,14 @@ int main(int argc, char const *argv[])
     std::cout << "Have read history with " << no << " items\n";
 
     for (unsigned int i = no-10; i < no; i++) {
-        std::cout << "Entry " << i << " " << history.Get(i) << "\n";
+        std::cout << "Entry " << i << " " << history.GetItem(i)->item << "\n";
+    }
+
+    if (argc > 2) {
+        std::string hint;
+        if (history.GetHint(argv[2], Utilities::GetCurrentDirectory(), hint)) {
+            std::cout << "Hint for " << argv[2] << ": " << hint << "\n";
+        }
     }
 
     return 0;
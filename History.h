@@ -8,16 +8,35 @@
   Class to manage shell history
 -----------------------------------------------------------------------------*/
 
-  
+
 #pragma once
 
 #include <vector>
 #include <string>
+#include <string_view>
 #include <memory>
+#include <mutex>
+#include <iterator>
 #include <unordered_map>
+#include <unordered_set>
 
 #include <crossline.h>
 
+#include "HistoryFile.h"
+#include "HistoryTrie.h"
+#include "HistoryList.h"
+#include "HistoryStore.h"
+#include "HistoryWriter.h"
+#include "HistoryCompact.h"
+#include "HistoryCold.h"
+#include "HistoryFuzzy.h"
+#include "HistoryTrigram.h"
+#include "HistoryNext.h"
+#include "HistoryShard.h"
+#include "HistoryFrecency.h"
+#include "HistoryFolderTree.h"
+#include "HistoryIndex.h"
+
 
 class CrabHistoryItem : public HistoryItem {
 public:
@@ -33,28 +52,256 @@ public:
 typedef std::shared_ptr<CrabHistoryItem> CrabHistoryItemPtr;
 
 
+// A read only range over a history list, iterating allocates nothing. It is
+// invalidated by the next Append.
+class HistoryView {
+protected:
+    const HistoryStoreClass *store;
+    const uint32_t *first;
+    const uint32_t *last;
+    size_t size;
+
+public:
+    class iterator {
+        // bidirectional, steps over the slots of moved entries
+        const HistoryStoreClass *store;
+        const uint32_t *cur;
+        const uint32_t *first;
+        const uint32_t *last;
+
+        struct Arrow {
+            HistoryEntry ent;
+            const HistoryEntry *operator->() const {return &ent;}
+        };
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef HistoryEntry value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef Arrow pointer;
+        typedef HistoryEntry reference;
+
+        iterator(const HistoryStoreClass *s, const uint32_t *c, const uint32_t *f, const uint32_t *l) :
+            store(s), cur(c), first(f), last(l) {}
+
+        // entries are built from the store's columns
+        reference operator*() const {return store->Get(*cur);}
+        pointer operator->() const {return {store->Get(*cur)};}
+        uint32_t Index() const {return *cur;}
+
+        iterator &operator++() {
+            do {
+                cur++;
+            } while (cur != last and *cur == HistoryListClass::noEntry);
+            return *this;
+        }
+        iterator &operator--() {
+            do {
+                cur--;
+            } while (cur != first and *cur == HistoryListClass::noEntry);
+            return *this;
+        }
+        iterator operator++(int) {iterator it = *this; ++(*this); return it;}
+        iterator operator--(int) {iterator it = *this; --(*this); return it;}
+        bool operator==(const iterator &it) const {return cur == it.cur;}
+        bool operator!=(const iterator &it) const {return cur != it.cur;}
+    };
+    typedef std::reverse_iterator<iterator> reverse_iterator;
+
+    HistoryView() : store(nullptr), first(nullptr), last(nullptr), size(0) {}
+    HistoryView(const HistoryStoreClass &st, const HistoryListClass &list) :
+        store(&st), first(list.Slots().data()), 
+        last(list.Slots().data() + list.Slots().size()), size(list.Size()) {}
+
+    iterator begin() const {
+        const uint32_t *p = first;
+        while (p != last and *p == HistoryListClass::noEntry) {
+            p++;
+        }
+        return iterator(store, p, first, last);
+    }
+    iterator end() const {return iterator(store, last, first, last);}
+    reverse_iterator rbegin() const {return reverse_iterator(end());}
+    reverse_iterator rend() const {return reverse_iterator(begin());}
+
+    size_t Size() const {return size;}
+    bool Empty() const {return size == 0;}
+};
+
+
 class ShellHistoryClass : public HistoryClass {
+    // Crossline reads the history through HistoryClass, so its items are
+    // kept in the same order as order, one for each loaded command
 protected:
-    // std::vector<HistoryItemPtr> history;            // store all the history
-    std::unordered_map<std::string, std::vector<HistoryItemPtr>> folderMap;    // map commands per folder
-    std::vector<HistoryItemPtr> noFolderMap;                                   // any commands without a folder
+    // The mapped file, the entries and the hint indices. Hint threads read it
+    // without locking, see HistoryIndexClass, the rest is only used here
+    std::shared_ptr<HistoryIndexClass> index;
+    std::unique_ptr<HistoryWriterClass> writer;     // background writer, if started
+    HistoryCompactorClass compactor;
+    HistoryListClass order;                         // the history in order, indices into the store
+
+    // map commands per folder id, folder 0 holds any commands without a folder
+    std::vector<HistoryListClass> folderMap;
+    HistoryFolderTreeClass folderTree;              // the folders by path, to find those above one
     std::string fileName;
 
-    int RevFind(const std::string &cmd, const int beg, const int end);
+    // following commands written by other shells
+    Utilities::FileWatch watch;
+    uint64_t syncOffset;                            // end of the records read from the file
+    uint64_t fileId;                                // to see the file being replaced
+    bool replaced;                                  // and it has been, for Refresh
+    std::unordered_multiset<std::string> ownRecords;    // appended here, not yet read back
+    std::string unwritten;                          // records appended while the file was locked
+
+    double halfLife;                                // of the frecency, in hours
+
+    // built on the first fuzzy search
+    HistoryFuzzyClass fuzzy;
+    bool fuzzyBuilt;
+
+    // substring search of the whole file, kept beside it and built on a thread
+    HistoryTrigramClass trigrams;
+
+    // the next token of a command, kept beside the file. The hint thread
+    // predicts from it while it is added to here
+    HistoryNextClass next;
+    mutable std::mutex nextMutex;
+
+    int loadThreads;
+
+    // Only the indexed records from windowStart are loaded, with the newest
+    // older records for the folders in use. The rest are cold, in index->cold
+    uint64_t windowStart;
+    size_t hotItems;
+    size_t folderItems;
+    size_t memLimit;
+    std::unordered_set<std::string> usedFolders;
+    std::vector<uint64_t> oldLoaded;                // index records before windowStart that are loaded, sorted
+
+    // the cold records by folder, to find a folder's without reading the rest
+    HistoryShardClass shards;
+    size_t noShards;
+
+    bool ImportText(const std::string &textFile, const std::string &binFile);
+    void ClearData();
+    bool ReadTail();
+    static std::string RecordKey(const int64_t time, const std::string_view &folder, const std::string_view &cmd);
+    uint32_t AddEntry(const std::string_view &cmd, const std::string_view &folder, const int64_t time,
+                      const uint32_t flags, const float weight=0);
+    void AddNewest(const std::string_view &cmd, const std::string_view &folder, const int64_t time,
+                   const uint32_t flags, const float weight=0);
+    void RebuildItems();
+    void AddFolders(const uint32_t first);
+    void AddRecords(const std::vector<HistoryFileClass::Record> &recs);
+    void GetWindowRecords(std::vector<HistoryFileClass::Record> &recs);
+    void WriteUnwritten(const bool force);
+    void AddOlder(const std::vector<uint64_t> &inds);
+    bool Reload();
+    HistoryItemPtr MakeItem(const uint32_t ent) const;
+
 public:
     ShellHistoryClass();
+    ~ShellHistoryClass();
 
+    // Load the binary history, converting a text history.dat in the same folder if needed
     bool Load(const std::string &inFile);
 
+    // The index hints are found from. Other threads can use it while this
+    // one adds to the history, it is replaced when the history is reloaded
+    std::shared_ptr<const HistoryIndexClass> GetIndex() const {return index;}
+
+    // the folders in the history that are folder or contain it, for FindHint
+    void FindFolders(const std::string &folder, std::vector<HistoryFolderTreeClass::Ancestor> &folders) const;
+
+    // threads used to load a large history, 0 for the number of cores
+    void SetLoadThreads(const int n);
+
+    // half life in hours of a use in the frecency of a command, set before Load
+    void SetHalfLife(const double hours);
+
+    // Load only the newest noItems records (0 for all) and up to noFolderItems
+    // older ones for each folder used. limit bytes (0 for none) bounds loading
+    // more and indexing the cold records. Set before Load
+    void SetWindow(const size_t noItems, const size_t noFolderItems, const size_t limit);
+
+    // split the records before the window into n shards by folder (0 for
+    // none), so those of a folder used are read from its shard. Set before Load
+    void SetShards(const size_t n);
+
+    // Called as item n is used, older records are loaded when it is near the
+    // oldest loaded. Returns the index of the same item afterwards
+    int Reach(const int n);
+
+    // load the recent cold records of folder, from its shard if there are shards
+    void UseFolder(const std::string &folder);
+    void Clear();
+
+    // Add any commands appended to the file by other shells, cheap when
+    // there are none so it can be called for every key. A file that has
+    // been replaced is only noted, it is read again by Refresh
+    bool Sync();
+
+    // as Sync, and the slower parts for the prompt: reading a replaced file
+    // again and taking up a next token table built in the background
+    bool Refresh();
+
+    // write appended commands from a background thread
+    void StartWriter(const HistoryWriterClass::Durability dur, const int intervalMS, const int batch);
+    void Flush();
+
+    // Rewrite the file without duplicates in the background, the result is
+    // given by CompactResult once it has finished
+    bool Compact(const HistoryRetention &keep);
+    bool CompactResult(std::string &msg);
+
+    // the share of the entries that are repeats of a command in the same folder
+    double DuplicateRatio() const;
+
     // bool GetMatch(const std::string &pref);
 
     unsigned int GetNoHistory() const {
-        return Size();
+        return order.Size();
     }
 
-    std::vector<HistoryItemPtr> GetFolderItems(const std::string &folder);
-    const std::vector<HistoryItemPtr> &GetNoFolderItems();
+    // create an item for entry n, 0 is the oldest
+    HistoryItemPtr GetItem(const int n) const;
+
+    // views of the history, newest last
+    HistoryView GetItems() const;
+    HistoryView GetFolderItems(const std::string &folder) const;
+
+    // the items of folder or, if it has none, of the nearest folder above it
+    // with history, distance is the number of levels up or -1 if none has
+    HistoryView GetNearestFolderItems(const std::string &folder, int &distance) const;
+    HistoryView GetNoFolderItems() const;
+
+    // The command starting with pref with the highest frecency in folder or
+    // the folders above it, less for each level up, or globally if one there
+    // is used much more, is the hint
+    bool GetHint(const std::string &pref, const std::string &folder, std::string &hint) const;
 
-    void Append(const std::string &cmd, const std::string &folder, const std::string &t, const bool appendToFile);
+    // the frecency of the loaded command in folder ("" for all folders) at time now
+    double GetFrecency(const std::string &cmd, const std::string &folder, const int64_t now) const;
+
+    void Append(const std::string &cmd, const std::string &folder, const int64_t t, const bool appendToFile,
+                const bool success=true);
+
+    // the loaded commands that best match query as a subsequence, best first
+    void FuzzySearch(const std::string &query, const size_t max, std::vector<HistoryEntry> &res);
+
+    // The newest different commands containing text, ignoring case, from
+    // the whole file once its index has been built, before then and for
+    // text shorter than a trigram from the loaded commands
+    void SubstringSearch(const std::string &text, const size_t max, std::vector<std::string> &res);
+
+    // The likeliest tokens to follow the command line, from the commands
+    // used in folder and then in all folders. They complete the token at the
+    // end of line, if any, and replace it from start. Can be called from
+    // another thread
+    bool PredictNext(const std::string &line, const std::string &folder, const size_t max,
+                     std::vector<std::string> &res, size_t &start) const;
+
+    size_t MemoryUsage() const {
+        return index->MemoryUsage() + fuzzy.MemoryUsage();
+    }
 };
 
@@ -0,0 +1,132 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2024, John Burnell
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  HistoryArray.h
+  Array that grows on one thread while others read it without locking
+-----------------------------------------------------------------------------*/
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <utility>
+
+
+template <typename T>
+class HistoryArrayClass {
+    // Elements are kept in chunks that double in size and never move, so an
+    // element can be read while later ones are added and a reference to one
+    // stays valid until Clear. Chunk c holds elements [64*(2^c - 1), 64*(2^(c+1) - 1)).
+    // There is one writer. It constructs an element before publishing the
+    // new size, so a reader sees every element below Size(). An element that
+    // is changed after it is added has to be atomic, or be reached through
+    // something that is published after the change.
+public:
+    static constexpr size_t firstChunk = 64;
+    static constexpr int maxChunks = 48;
+
+protected:
+    std::atomic<T*> chunks[maxChunks];
+    std::atomic<size_t> size;
+
+    static int Chunk(const size_t i, size_t &offset) {
+        size_t n = i / firstChunk + 1;
+        int c = 63 - __builtin_clzll(n);
+        offset = i - firstChunk*((size_t(1) << c) - 1);
+        return c;
+    }
+
+    T *Slot(const size_t i) {
+        size_t offset;
+        int c = Chunk(i, offset);
+        T *chunk = chunks[c].load(std::memory_order_relaxed);
+        if (chunk == nullptr) {
+            chunk = static_cast<T*>(::operator new(sizeof(T) * (firstChunk << c)));
+            chunks[c].store(chunk, std::memory_order_release);
+        }
+        return chunk + offset;
+    }
+
+public:
+    HistoryArrayClass() : size(0) {
+        for (auto &chunk : chunks) {
+            chunk.store(nullptr, std::memory_order_relaxed);
+        }
+    }
+    ~HistoryArrayClass() {Clear();}
+    HistoryArrayClass(const HistoryArrayClass&) = delete;
+    void operator=(const HistoryArrayClass&) = delete;
+
+    // only when nothing is reading
+    void Clear() {
+        size_t n = size.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < n; i++) {
+            (*this)[i].~T();
+        }
+        for (auto &chunk : chunks) {
+            ::operator delete(chunk.load(std::memory_order_relaxed));
+            chunk.store(nullptr, std::memory_order_relaxed);
+        }
+        size.store(0, std::memory_order_release);
+    }
+
+    template <typename... Args>
+    T &Add(Args&&... args) {
+        size_t n = size.load(std::memory_order_relaxed);
+        T *p = new (Slot(n)) T(std::forward<Args>(args)...);
+        size.store(n+1, std::memory_order_release);
+        return *p;
+    }
+
+    // add elements copied from val up to n
+    void Resize(const size_t n, const T &val) {
+        size_t i = size.load(std::memory_order_relaxed);
+        for (; i < n; i++) {
+            new (Slot(i)) T(val);
+        }
+        if (i > size.load(std::memory_order_relaxed)) {
+            size.store(i, std::memory_order_release);
+        }
+    }
+
+    // add default elements up to n
+    void Resize(const size_t n) {
+        size_t i = size.load(std::memory_order_relaxed);
+        for (; i < n; i++) {
+            new (Slot(i)) T();
+        }
+        if (i > size.load(std::memory_order_relaxed)) {
+            size.store(i, std::memory_order_release);
+        }
+    }
+
+    size_t Size() const {return size.load(std::memory_order_acquire);}
+    bool Empty() const {return Size() == 0;}
+
+    T &operator[](const size_t i) {
+        size_t offset;
+        int c = Chunk(i, offset);
+        return chunks[c].load(std::memory_order_acquire)[offset];
+    }
+    const T &operator[](const size_t i) const {
+        size_t offset;
+        int c = Chunk(i, offset);
+        return chunks[c].load(std::memory_order_acquire)[offset];
+    }
+
+    T &Back() {return (*this)[size.load(std::memory_order_relaxed) - 1];}
+
+    size_t MemoryUsage() const {
+        size_t mem = 0;
+        for (int c = 0; c < maxChunks; c++) {
+            if (chunks[c].load(std::memory_order_relaxed) != nullptr) {
+                mem += sizeof(T) * (firstChunk << c);
+            }
+        }
+        return mem;
+    }
+};
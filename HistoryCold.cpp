@@ -0,0 +1,153 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2024, John Burnell
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  HistoryCold.cpp
+  Older history records that are left in the file until needed
+-----------------------------------------------------------------------------*/
+
+#include <algorithm>
+
+#include "HistoryCold.h"
+
+
+HistoryColdClass::HistoryColdClass()
+{
+    file = nullptr;
+    memLimit = 0;
+    memUsed = 0;
+    stop = false;
+}
+
+
+HistoryColdClass::~HistoryColdClass()
+{
+    Stop();
+}
+
+
+void HistoryColdClass::Start(const HistoryFileClass &f, const uint64_t noRecords, const size_t limit)
+{
+    Stop();
+    file = &f;
+    memLimit = limit;
+    for (uint64_t first = 0; first < noRecords; first += segmentSize) {
+        segments.push_back(std::make_unique<Segment>());
+        Segment &seg = *segments.back();
+        seg.first = first;
+        seg.last = std::min(first + segmentSize, noRecords);
+        seg.ready = false;
+    }
+    if (!segments.empty()) {
+        stop = false;
+        thread = std::thread(&HistoryColdClass::Prefetch, this);
+    }
+}
+
+
+void HistoryColdClass::Stop()
+{
+    // the file must stay mapped until the thread has finished
+    stop = true;
+    if (thread.joinable()) {
+        thread.join();
+    }
+    segments.clear();
+    memUsed = 0;
+    file = nullptr;
+}
+
+
+void HistoryColdClass::Prefetch()
+{
+    // The memory limit is checked before a segment is started, from the size
+    // of those built so far, and as it is built. One that goes over is dropped
+    size_t noBuilt = 0;
+    for (auto it = segments.rbegin(); it != segments.rend() and !stop; it++) {
+        Segment &seg = **it;
+        uint64_t noRecords = seg.last - seg.first;
+        if (memLimit > 0 and noBuilt > 0 and memUsed + memUsed / noBuilt * noRecords > memLimit) {
+            return;
+        }
+        file->WillNeed(seg.first, seg.last);
+
+        size_t mem = 0;
+        HistoryFileClass::Record rec;
+        for (uint64_t i = seg.first; i < seg.last and !stop; i++) {
+            if (file->DecodeIndexed(i, rec)) {
+                seg.trie.Insert(rec.cmd, i);
+                std::vector<uint32_t> &recs = seg.folderRecords[rec.folder];
+                if (recs.empty()) {
+                    mem += rec.folder.size() + 64;
+                }
+                recs.push_back(i);
+            }
+            if (memLimit > 0 and (i - seg.first) % 1024 == 1023 and
+                memUsed + mem + seg.trie.MemoryUsage() + (i - seg.first)*sizeof(uint32_t) > memLimit) {
+                // not ready, so nothing is reading it
+                seg.trie.Clear();
+                seg.folderRecords = {};
+                return;
+            }
+        }
+        if (stop) {
+            return;
+        }
+        mem += seg.trie.MemoryUsage() + noRecords*sizeof(uint32_t);
+        memUsed += mem;
+        noBuilt += noRecords;
+        seg.ready = true;
+    }
+}
+
+
+bool HistoryColdClass::FindHint(const std::string_view &pref, std::string_view &cmd) const
+{
+    for (auto it = segments.rbegin(); it != segments.rend(); it++) {
+        const Segment &seg = **it;
+        if (!seg.ready) {
+            return false;
+        }
+        uint32_t ind = seg.trie.Find(pref);
+        HistoryFileClass::Record rec;
+        if (ind != HistoryTrieClass::noEntry and file->DecodeIndexed(ind, rec)) {
+            cmd = rec.cmd;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+void HistoryColdClass::FolderRecords(const std::string_view &folder, const size_t max, const size_t maxScan,
+                                     std::vector<uint64_t> &inds) const
+{
+    // collected newest first
+    inds.clear();
+    size_t noScanned = 0;
+    HistoryFileClass::Record rec;
+    for (auto it = segments.rbegin(); it != segments.rend() and inds.size() < max; it++) {
+        const Segment &seg = **it;
+        if (seg.ready) {
+            auto recs = seg.folderRecords.find(folder);
+            if (recs != seg.folderRecords.end()) {
+                for (auto ind = recs->second.rbegin(); ind != recs->second.rend() and inds.size() < max; ind++) {
+                    inds.push_back(*ind);
+                }
+            }
+            continue;
+        }
+        for (uint64_t i = seg.last; i > seg.first and inds.size() < max; i--) {
+            if (noScanned++ >= maxScan) {
+                std::reverse(inds.begin(), inds.end());
+                return;
+            }
+            if (file->DecodeIndexed(i-1, rec) and rec.folder == folder) {
+                inds.push_back(i-1);
+            }
+        }
+    }
+    std::reverse(inds.begin(), inds.end());
+}
@@ -0,0 +1,73 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2024, John Burnell
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  HistoryCold.h
+  Older history records that are left in the file until needed
+-----------------------------------------------------------------------------*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "HistoryFile.h"
+#include "HistoryTrie.h"
+
+
+class HistoryColdClass {
+    // The indexed records before the loaded window, split into segments. A
+    // background thread reads the segments ahead, newest first, and builds a
+    // trie of each segment's commands and its records per folder while they
+    // fit in the memory limit. A segment is only used once it is complete, so
+    // the readers need no lock. Until then the records are found by scanning.
+public:
+    static constexpr uint64_t segmentSize = 64*1024;
+
+protected:
+    struct Segment {
+        uint64_t first, last;                   // index records [first, last)
+        HistoryTrieClass trie;                  // entries are index records
+        std::unordered_map<std::string_view, std::vector<uint32_t>> folderRecords;
+        std::atomic<bool> ready;
+    };
+
+    const HistoryFileClass *file;
+    std::vector<std::unique_ptr<Segment>> segments;
+    size_t memLimit;
+    std::atomic<size_t> memUsed;
+    std::atomic<bool> stop;
+    std::thread thread;
+
+    void Prefetch();
+
+public:
+    HistoryColdClass();
+    ~HistoryColdClass();
+
+    // index records [0, noRecords) of file are cold, memLimit bytes (0 for no
+    // limit) can be used for the segment indices
+    void Start(const HistoryFileClass &f, const uint64_t noRecords, const size_t limit);
+    void Stop();
+
+    // stop reading ahead, leaving the segments read for any readers
+    void Cancel() {stop = true;}
+
+    uint64_t Size() const {return segments.empty() ? 0 : segments.back()->last;}
+    size_t MemoryUsage() const {return memUsed;}
+
+    // the newest cold command starting with pref from the segments read so far
+    bool FindHint(const std::string_view &pref, std::string_view &cmd) const;
+
+    // up to max of the newest records for folder, oldest first. Segments not
+    // read yet are scanned, looking at no more than maxScan records
+    void FolderRecords(const std::string_view &folder, const size_t max, const size_t maxScan,
+                       std::vector<uint64_t> &inds) const;
+};
@@ -0,0 +1,170 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2024, John Burnell
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  HistoryCompact.cpp
+  Rewrite the history file without duplicates or expired commands
+-----------------------------------------------------------------------------*/
+
+#include <algorithm>
+#include <ctime>
+#include <sstream>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "HistoryCompact.h"
+#include "HistoryFile.h"
+#include "HistoryFrecency.h"
+#include "Utilities.h"
+
+
+namespace {
+    struct RecordKey {
+        std::string_view folder;
+        std::string_view cmd;
+        bool failed;
+
+        bool operator==(const RecordKey &k) const {
+            return failed == k.failed and folder == k.folder and cmd == k.cmd;
+        }
+    };
+
+    struct RecordHash {
+        size_t operator()(const RecordKey &k) const {
+            std::hash<std::string_view> h;
+            return (h(k.folder) * 31 + h(k.cmd)) * 2 + k.failed;
+        }
+    };
+}
+
+
+HistoryCompactorClass::HistoryCompactorClass()
+{
+    running = false;
+}
+
+
+HistoryCompactorClass::~HistoryCompactorClass()
+{
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+
+bool HistoryCompactorClass::Start(const std::string &fileName, const HistoryRetention &keep)
+{
+    if (running) {
+        return false;
+    }
+    if (thread.joinable()) {
+        thread.join();
+    }
+    running = true;
+    thread = std::thread([this, fileName, keep]() {
+        std::string msg;
+        Compact(fileName, keep, msg);
+        Utilities::LogMessage(msg);
+        {
+            std::lock_guard<std::mutex> lck(mutex);
+            result = msg;
+        }
+        running = false;
+    });
+    return true;
+}
+
+
+bool HistoryCompactorClass::GetResult(std::string &msg)
+{
+    std::lock_guard<std::mutex> lck(mutex);
+    if (result.empty()) {
+        return false;
+    }
+    msg.swap(result);
+    result.clear();
+    return true;
+}
+
+
+bool HistoryCompactorClass::Compact(const std::string &fileName, const HistoryRetention &keep, std::string &msg)
+{
+    // read what is there now without holding the lock
+    uint64_t fileId = Utilities::GetFileId(fileName);
+    HistoryFileClass file;
+    if (!file.Open(fileName)) {
+        msg = "Cannot read history file " + fileName;
+        return false;
+    }
+    std::vector<HistoryFileClass::Record> recs;
+    file.GetRecords(recs);
+    uint64_t readEnd = file.ValidEnd();
+    size_t noRead = recs.size();
+
+    Utilities::FileLock lck(fileName);
+    if (!lck.HasLock()) {
+        msg = "History file is locked by another shell, not compacted";
+        return false;
+    }
+
+    // add anything appended since, unless another shell has compacted it
+    std::string tail;
+    uint64_t id;
+    if (!Utilities::ReadFileTail(fileName, readEnd, tail, id) or id != fileId) {
+        msg = "History file changed during compaction, not compacted";
+        return false;
+    }
+    HistoryFileClass::Scan(tail.data(), tail.size(), 0, recs);
+
+    // newest first, keep one use of each command per folder, and one failed
+    // use so failures are still told apart. The kept record has the number of
+    // uses it replaces for the next-command counts and their frecency weight,
+    // each decayed to its time, so the command's frecency is unchanged
+    HistoryFrecencyClass frecency;
+    frecency.SetHalfLife(keep.halfLife);
+    std::unordered_map<RecordKey, size_t, RecordHash> seen;
+    seen.reserve(recs.size());
+    int64_t oldest = 0;
+    if (keep.maxDays > 0) {
+        oldest = int64_t(std::time(nullptr)) - int64_t(keep.maxDays)*24*3600;
+    }
+    std::vector<HistoryFileClass::Record> kept;
+    for (auto it = recs.rbegin(); it != recs.rend(); it++) {
+        if (keep.maxEntries > 0 and kept.size() >= keep.maxEntries) {
+            break;
+        }
+        if (it->time > 0 and it->time < oldest) {
+            continue;
+        }
+        bool failed = it->flags & HistoryFileClass::failedFlag;
+        auto ins = seen.insert({{it->folder, it->cmd, failed}, kept.size()});
+        if (ins.second) {
+            kept.push_back(*it);
+        } else {
+            HistoryFileClass::Record &rec = kept[ins.first->second];
+            rec.weight = float(HistoryFileClass::Weight(rec) +
+                               HistoryFileClass::Weight(*it) * frecency.Decay(rec.time - it->time));
+            uint32_t uses = std::min(HistoryFileClass::Uses(rec.flags) + HistoryFileClass::Uses(it->flags),
+                                     HistoryFileClass::maxUses + 1);
+            rec.flags = (rec.flags & ((1U << HistoryFileClass::usesShift) - 1)) | 
+                        ((uses - 1) << HistoryFileClass::usesShift);
+        }
+    }
+    std::reverse(kept.begin(), kept.end());
+
+    if (!HistoryFileClass::Write(fileName, kept)) {
+        msg = "Error writing compacted history " + fileName;
+        return false;
+    }
+
+    std::ostringstream out;
+    out << "Compacted history from " << recs.size() << " to " << kept.size() << " items";
+    if (recs.size() > noRead) {
+        out << " (" << recs.size() - noRead << " added while compacting)";
+    }
+    msg = out.str();
+    return true;
+}
@@ -0,0 +1,50 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2024, John Burnell
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  HistoryCompact.h
+  Rewrite the history file without duplicates or expired commands
+-----------------------------------------------------------------------------*/
+
+#pragma once
+
+#include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+
+struct HistoryRetention {
+    size_t maxEntries = 0;   // keep the newest, 0 for no limit
+    int maxDays = 0;         // drop commands older than this, 0 for no limit
+    double halfLife = 72.0;  // of the frecency, in hours
+};
+
+
+class HistoryCompactorClass {
+    // Compaction keeps the newest use of each command in each folder, and the
+    // newest failed use, with the frecency of the uses it replaces. The file
+    // is read without a lock, then under the exclusive history lock anything
+    // appended since is added and the result is written to a temporary file
+    // and renamed over the history. Other shells see the rename and reload.
+protected:
+    std::thread thread;
+    std::atomic<bool> running;
+    std::mutex mutex;
+    std::string result;
+
+public:
+    HistoryCompactorClass();
+    ~HistoryCompactorClass();
+
+    // compact in a background thread, false if one is already running
+    bool Start(const std::string &fileName, const HistoryRetention &keep);
+    bool IsRunning() const {return running;}
+
+    // the message from a finished compaction, once
+    bool GetResult(std::string &msg);
+
+    static bool Compact(const std::string &fileName, const HistoryRetention &keep, std::string &msg);
+};
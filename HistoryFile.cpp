@@ -0,0 +1,405 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2024, John Burnell
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  HistoryFile.cpp
+  Binary, append-only history log
+-----------------------------------------------------------------------------*/
+
+
+#include <algorithm>
+#include <fstream>
+#include <cstring>
+#include <functional>
+
+#ifndef __WIN32__
+# include <cerrno>
+# include <fcntl.h>
+# include <unistd.h>
+#endif
+
+#include <filesystem>
+namespace fs = std::filesystem;
+
+#include "HistoryFile.h"
+
+
+const char HistoryFileClass::headerMagic[8] = {'C', 'R', 'A', 'B', 'H', 'I', 'S', 'T'};
+const char HistoryFileClass::indexMagic[8] = {'C', 'R', 'A', 'B', 'I', 'N', 'D', 'X'};
+
+
+template <typename T>
+static T ReadValue(const char *p)
+{
+    T val;
+    std::memcpy(&val, p, sizeof(T));
+    return val;
+}
+
+template <typename T>
+static void WriteValue(std::string &buf, const T val)
+{
+    buf.append(reinterpret_cast<const char*>(&val), sizeof(T));
+}
+
+
+HistoryFileClass::HistoryFileClass()
+{
+    indexOffset = 0;
+    indexCount = 0;
+    tailStart = 0;
+    validEnd = 0;
+}
+
+
+bool HistoryFileClass::Open(const std::string &fileName)
+{
+    Close();
+    if (!map.Open(fileName)) {
+        return false;
+    }
+    if (!ReadHeader()) {
+        Close();
+        return false;
+    }
+    return true;
+}
+
+
+void HistoryFileClass::Close()
+{
+    map.Close();
+    indexOffset = indexCount = tailStart = validEnd = 0;
+}
+
+
+bool HistoryFileClass::ReadHeader()
+{
+    const char *data = map.Data();
+    uint64_t size = map.Size();
+    if (size < headerSize or std::memcmp(data, headerMagic, 8) != 0) {
+        return false;
+    }
+    uint32_t ver = ReadValue<uint32_t>(data+8);
+    if (ver < minVersion or ver > version) {
+        return false;
+    }
+
+    tailStart = ReadValue<uint32_t>(data+12);
+    if (tailStart < headerSize or tailStart > size) {
+        return false;
+    }
+    validEnd = tailStart;
+    indexOffset = ReadValue<uint64_t>(data+16);
+    indexCount = ReadValue<uint64_t>(data+24);
+    if (indexOffset == 0) {
+        indexCount = 0;
+        return true;
+    }
+
+    // check the index, if it is damaged ignore it and scan all the records.
+    // The sizes are compared with what is left of the file so that values
+    // read from a damaged header cannot overflow
+    bool good = indexOffset >= tailStart and indexOffset <= size and size - indexOffset >= indexHeaderSize and
+                indexCount <= (size - indexOffset - indexHeaderSize) / 8;
+    const char *idx = good ? data + indexOffset : nullptr;
+    good = good and std::memcmp(idx, indexMagic, 8) == 0 and
+           ReadValue<uint64_t>(idx+8) == indexCount and
+           ReadValue<uint32_t>(idx+16) == Utilities::Crc32(idx+indexHeaderSize, indexCount*8);
+    if (!good) {
+        Utilities::LogMessage("History index is damaged, scanning all records");
+        indexOffset = 0;
+        indexCount = 0;
+        return true;
+    }
+
+    tailStart = indexOffset + indexHeaderSize + indexCount*8;
+    validEnd = tailStart;
+    return true;
+}
+
+
+uint64_t HistoryFileClass::DecodeRecord(const uint64_t offset, Record &rec, const bool checkCRC) const
+{
+    return Decode(map.Data(), map.Size(), offset, rec, checkCRC);
+}
+
+
+uint64_t HistoryFileClass::Decode(const char *data, const uint64_t size, const uint64_t offset, 
+                                  Record &rec, const bool checkCRC)
+{
+    // offsets can come from the index, so are compared with what is left
+    if (offset > size or size - offset < recordHeaderSize) {
+        return 0;
+    }
+
+    const char *p = data + offset;
+    uint32_t len = ReadValue<uint32_t>(p+4);
+    if (ReadValue<uint32_t>(p) != recordTag or len < payloadHeaderSize or
+        len > size - offset - recordHeaderSize) {
+        return 0;
+    }
+
+    const char *payload = p + recordHeaderSize;
+    if (checkCRC and Utilities::Crc32(payload, len) != ReadValue<uint32_t>(p+8)) {
+        return 0;
+    }
+
+    uint32_t folderLen = ReadValue<uint32_t>(payload+12);
+    rec.flags = ReadValue<uint32_t>(payload+8);
+    uint64_t start = payloadHeaderSize + ((rec.flags & weightFlag) ? 4 : 0);
+    if (start + uint64_t(folderLen) > len) {
+        return 0;
+    }
+    rec.time = ReadValue<int64_t>(payload);
+    rec.weight = (rec.flags & weightFlag) ? ReadValue<float>(payload+payloadHeaderSize) : 0.0f;
+    rec.folder = std::string_view(payload+start, folderLen);
+    rec.cmd = std::string_view(payload+start+folderLen, len-start-folderLen);
+
+    return offset + recordHeaderSize + len;
+}
+
+
+uint64_t HistoryFileClass::Scan(const char *data, const uint64_t size, const uint64_t start, 
+                                std::vector<Record> &recs, std::vector<uint64_t> *offsets)
+{
+    // records are checked and a damaged record is skipped by searching for
+    // the next tag, a record still being written at the end stops the scan
+    const uint32_t tagVal = recordTag;
+    char tag[4];
+    std::memcpy(tag, &tagVal, 4);
+    uint64_t validEnd = start;
+    uint64_t pos = start;
+    Record rec;
+    while (pos + recordHeaderSize <= size) {
+        uint64_t next = Decode(data, size, pos, rec, true);
+        if (next > 0) {
+            recs.push_back(rec);
+            if (offsets != nullptr) {
+                offsets->push_back(pos);
+            }
+            validEnd = pos = next;
+            continue;
+        }
+        // search for the next tag
+        const char *p = data + pos + 1;
+        const char *end = data + size - 3;
+        while (p < end and ((p = static_cast<const char*>(std::memchr(p, tag[0], end-p))) != nullptr)) {
+            if (std::memcmp(p, tag, 4) == 0) {
+                break;
+            }
+            p++;
+        }
+        if (p == nullptr or p >= end) {
+            break;
+        }
+        pos = p - data;
+    }
+    return validEnd;
+}
+
+
+bool HistoryFileClass::DecodeIndexed(const uint64_t i, Record &rec) const
+{
+    if (i >= indexCount) {
+        return false;
+    }
+    return DecodeRecord(IndexedOffset(i), rec, false) > 0;
+}
+
+
+uint64_t HistoryFileClass::IndexedOffset(const uint64_t i) const
+{
+    const char *offsets = map.Data() + indexOffset + indexHeaderSize;
+    return ReadValue<uint64_t>(offsets+i*8);
+}
+
+
+void HistoryFileClass::WillNeed(const uint64_t first, const uint64_t last) const
+{
+    if (first >= last or last > indexCount) {
+        return;
+    }
+    const char *offsets = map.Data() + indexOffset + indexHeaderSize;
+    uint64_t start = ReadValue<uint64_t>(offsets+first*8);
+    uint64_t end = last < indexCount ? ReadValue<uint64_t>(offsets+last*8) : indexOffset;
+    if (start < end and end <= map.Size()) {
+        map.WillNeed(start, end-start);
+    }
+}
+
+
+bool HistoryFileClass::GetRecords(std::vector<Record> &recs, const int noThreads, const uint64_t first)
+{
+    recs.clear();
+    if (!IsOpen()) {
+        return false;
+    }
+    const char *data = map.Data();
+
+    // records covered by the index were checked when the file was rewritten,
+    // each chunk decodes into its own part of recs so the order is kept
+    uint64_t noIndexed = first < indexCount ? indexCount - first : 0;
+    recs.reserve(noIndexed + 64);
+    recs.resize(noIndexed);
+    const char *offsets = data + indexOffset + indexHeaderSize;
+    const uint64_t chunkSize = 64*1024;
+    std::vector<std::function<void()>> tasks;
+    for (uint64_t start = 0; start < noIndexed; start += chunkSize) {
+        uint64_t end = std::min(start + chunkSize, noIndexed);
+        tasks.push_back([this, &recs, offsets, first, start, end]() {
+            for (uint64_t i = start; i < end; i++) {
+                if (DecodeRecord(ReadValue<uint64_t>(offsets+(first+i)*8), recs[i], false) == 0) {
+                    recs[i].cmd = std::string_view();
+                }
+            }
+        });
+    }
+    Utilities::RunTasks(tasks, noThreads);
+    recs.erase(std::remove_if(recs.begin(), recs.end(), [](const Record &rec) {
+        return rec.cmd.data() == nullptr;
+    }), recs.end());
+
+    // records appended since
+    validEnd = Scan(data, map.Size(), tailStart, recs);
+
+    return true;
+}
+
+
+void HistoryFileClass::EncodeRecord(const Record &rec, std::string &buf)
+{
+    bool hasWeight = rec.weight > 0;
+    uint32_t flags = hasWeight ? (rec.flags | weightFlag) : (rec.flags & ~weightFlag);
+    uint32_t len = payloadHeaderSize + (hasWeight ? 4 : 0) + rec.folder.size() + rec.cmd.size();
+    size_t start = buf.size();
+    WriteValue<uint32_t>(buf, recordTag);
+    WriteValue<uint32_t>(buf, len);
+    WriteValue<uint32_t>(buf, 0);
+    WriteValue<int64_t>(buf, rec.time);
+    WriteValue<uint32_t>(buf, flags);
+    WriteValue<uint32_t>(buf, rec.folder.size());
+    if (hasWeight) {
+        WriteValue<float>(buf, rec.weight);
+    }
+    buf.append(rec.folder);
+    buf.append(rec.cmd);
+
+    uint32_t crc = Utilities::Crc32(buf.data()+start+recordHeaderSize, len);
+    std::memcpy(&buf[start+8], &crc, 4);
+}
+
+
+static void EncodeHeader(std::string &buf, const uint64_t indexOffset, const uint64_t indexCount)
+{
+    buf.append(HistoryFileClass::headerMagic, 8);
+    WriteValue<uint32_t>(buf, HistoryFileClass::version);
+    WriteValue<uint32_t>(buf, HistoryFileClass::headerSize);
+    WriteValue<uint64_t>(buf, indexOffset);
+    WriteValue<uint64_t>(buf, indexCount);
+}
+
+
+bool HistoryFileClass::IsHistoryFile(const std::string &fileName)
+{
+    std::ifstream inp(fileName, std::ios::binary);
+    char magic[8];
+    if (!inp.read(magic, 8)) {
+        return false;
+    }
+    return std::memcmp(magic, headerMagic, 8) == 0;
+}
+
+
+bool HistoryFileClass::Create(const std::string &fileName)
+{
+    return Write(fileName, std::vector<Record>());
+}
+
+
+bool HistoryFileClass::Write(const std::string &fileName, const std::vector<Record> &recs)
+{
+    std::string buf;
+    size_t noRecs = recs.size();
+    std::vector<uint64_t> offsets(noRecs);
+
+    EncodeHeader(buf, 0, 0);
+    for (size_t i = 0; i < noRecs; i++) {
+        offsets[i] = buf.size();
+        EncodeRecord(recs[i], buf);
+    }
+
+    uint64_t indexOffset = 0;
+    if (noRecs > 0) {
+        indexOffset = buf.size();
+        buf.append(indexMagic, 8);
+        WriteValue<uint64_t>(buf, noRecs);
+        WriteValue<uint32_t>(buf, Utilities::Crc32(reinterpret_cast<const char*>(offsets.data()), noRecs*8));
+        WriteValue<uint32_t>(buf, 0);
+        WriteValue<uint64_t>(buf, 0);
+        buf.append(reinterpret_cast<const char*>(offsets.data()), noRecs*8);
+
+        std::string header;
+        EncodeHeader(header, indexOffset, noRecs);
+        buf.replace(0, headerSize, header);
+    }
+
+    // it may be the only copy of the history, so it is on the disk before
+    // it replaces the old one, and the rename is on the disk before returning
+    std::string tmpName = fileName + ".tmp";
+    if (!Utilities::WriteTempFile(tmpName, {buf}, true)) {
+        Utilities::LogError("Error: cannot write history file " + fileName);
+        return false;
+    }
+    return Utilities::ReplaceFile(tmpName, fileName, true);
+}
+
+
+bool HistoryFileClass::Append(const std::string &fileName, const Record &rec)
+{
+    std::string buf;
+    EncodeRecord(rec, buf);
+    return AppendData(fileName, buf);
+}
+
+
+bool HistoryFileClass::AppendData(const std::string &fileName, const std::string &buf, const bool sync)
+{
+#ifdef __WIN32__
+    std::ofstream ofs(fileName, std::ios::binary | std::ios::app);
+    if (!ofs) {
+        return false;
+    }
+    ofs.write(buf.data(), buf.size());
+    ofs.flush();
+    return bool(ofs);
+#else
+    // with O_APPEND the kernel places each write at the end of the file, so
+    // records from other shells never interleave with this one
+    int fd = open(fileName.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+    if (fd < 0) {
+        Utilities::LogError("Error: cannot open history file " + fileName);
+        return false;
+    }
+    const char *p = buf.data();
+    size_t left = buf.size();
+    while (left > 0) {
+        ssize_t n = write(fd, p, left);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        p += n;
+        left -= n;
+    }
+    if (sync) {
+        fsync(fd);
+    }
+    close(fd);
+    return left == 0;
+#endif
+}
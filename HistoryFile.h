@@ -0,0 +1,125 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2024, John Burnell
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  HistoryFile.h
+  Binary, append-only history log
+
+  The file is a header followed by length-prefixed, checksummed records. A
+  rewrite of the file (conversion, compaction) places an index of the record
+  offsets after the records and stores its position in the header. Records
+  appended later follow the index and are found by scanning the tail.
+
+  Header:  "CRABHIST" u32 version, u32 headerSize, u64 indexOffset, u64 indexCount
+  Record:  u32 tag, u32 payloadLen, u32 crc32(payload)
+           payload: i64 time, u32 flags, u32 folderLen, [f32 weight], folder, cmd
+  Flags:   bit 0 set if the command failed, bit 1 set if the weight is there,
+           bits 8-31 the number of older uses of the command merged into the
+           record by a compaction
+  Weight:  the frecency weight of the uses merged into the record, decayed to
+           its time (version 2 on)
+  Index:   "CRABINDX" u64 count, u32 crc32(offsets), u32 unused, u64 unused,
+           u64 offsets[count]
+
+  All values are stored in the host (little endian) byte order.
+-----------------------------------------------------------------------------*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Utilities.h"
+
+
+class HistoryFileClass {
+public:
+    struct Record {
+        int64_t time;
+        uint32_t flags;
+        std::string_view cmd;
+        std::string_view folder;
+        float weight = 0;        // of the merged uses if not 0, otherwise its uses
+    };
+
+    static const char headerMagic[8];
+    static const char indexMagic[8];
+    static constexpr uint32_t recordTag = 0x52424352;    // "RCBR"
+    static constexpr uint32_t version = 2;
+    static constexpr uint32_t minVersion = 1;       // still read
+    static constexpr size_t headerSize = 32;
+    static constexpr size_t recordHeaderSize = 12;
+    static constexpr size_t payloadHeaderSize = 16;
+    static constexpr size_t indexHeaderSize = 32;
+    static constexpr uint32_t failedFlag = 1;
+    static constexpr uint32_t weightFlag = 2;
+    static constexpr int usesShift = 8;
+    static constexpr uint32_t maxUses = 0xFFFFFF;
+
+    // the uses a record stands for, itself and any merged into it
+    static uint32_t Uses(const uint32_t flags) {return 1 + (flags >> usesShift);}
+    // their weight at the record's time
+    static double Weight(const Record &rec) {return rec.weight > 0 ? rec.weight : Uses(rec.flags);}
+
+protected:
+    Utilities::MappedFile map;
+    uint64_t indexOffset;
+    uint64_t indexCount;
+    uint64_t tailStart;          // first byte after the index (or the header)
+    uint64_t validEnd;           // end of the last good record
+
+    bool ReadHeader();
+
+public:
+    HistoryFileClass();
+
+    // Map fileName and check the header, the records stay valid until Close
+    bool Open(const std::string &fileName);
+    void Close();
+
+    // Decode the records referenced by the index from first and then the tail.
+    // The index is split into chunks decoded on up to noThreads threads
+    bool GetRecords(std::vector<Record> &recs, const int noThreads=1, const uint64_t first=0);
+
+    // the records in the index, which are in file order
+    uint64_t NoIndexed() const {return indexCount;}
+    bool DecodeIndexed(const uint64_t i, Record &rec) const;
+    uint64_t IndexedOffset(const uint64_t i) const;
+    uint64_t TailStart() const {return tailStart;}
+
+    // ask for index records [first, last) to be read in ahead of use
+    void WillNeed(const uint64_t first, const uint64_t last) const;
+
+    // Decode the record at offset, returns the offset of the next record or 0 on error
+    uint64_t DecodeRecord(const uint64_t offset, Record &rec, const bool checkCRC) const;
+    static uint64_t Decode(const char *data, const uint64_t size, const uint64_t offset, 
+                           Record &rec, const bool checkCRC);
+
+    // Decode the records in data from start, returns the end of the last good
+    // record. The offset of each record is added to offsets if given
+    static uint64_t Scan(const char *data, const uint64_t size, const uint64_t start, 
+                         std::vector<Record> &recs, std::vector<uint64_t> *offsets=nullptr);
+
+    uint64_t ValidEnd() const {return validEnd;}
+    bool IsOpen() const {return map.Data() != nullptr;}
+    const char *Data() const {return map.Data();}
+    size_t Size() const {return map.Size();}
+
+    static bool IsHistoryFile(const std::string &fileName);
+    static void EncodeRecord(const Record &rec, std::string &buf);
+
+    // Create an empty history file
+    static bool Create(const std::string &fileName);
+
+    // Rewrite the whole file with an index, written to a temporary and renamed.
+    // The caller should hold an exclusive FileLock
+    static bool Write(const std::string &fileName, const std::vector<Record> &recs);
+
+    // Append a record with a single write, the caller should hold a shared FileLock
+    static bool Append(const std::string &fileName, const Record &rec);
+    static bool AppendData(const std::string &fileName, const std::string &buf, const bool sync=false);
+};
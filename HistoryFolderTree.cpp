@@ -0,0 +1,92 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2024, John Burnell
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  HistoryFolderTree.cpp
+  Trie of the history folders by path component
+-----------------------------------------------------------------------------*/
+
+#include <algorithm>
+
+#include "HistoryFolderTree.h"
+
+
+HistoryFolderTreeClass::HistoryFolderTreeClass()
+{
+    Clear();
+}
+
+
+void HistoryFolderTreeClass::Clear()
+{
+    folderIds.assign(1, noFolder);
+    children.clear();
+}
+
+
+void HistoryFolderTreeClass::SplitPath(const std::string_view &folder, std::vector<std::string_view> &parts)
+{
+    parts.clear();
+    size_t start = 0;
+    for (size_t i = 0; i <= folder.size(); i++) {
+#ifdef __WIN32__
+        bool sep = i == folder.size() or folder[i] == '/' or folder[i] == '\\';
+#else
+        bool sep = i == folder.size() or folder[i] == '/';
+#endif
+        if (sep) {
+            if (i > start) {
+                parts.push_back(folder.substr(start, i-start));
+            }
+            start = i+1;
+        }
+    }
+}
+
+
+void HistoryFolderTreeClass::Add(const std::string_view &folder, const uint32_t folderId)
+{
+    std::vector<std::string_view> parts;
+    SplitPath(folder, parts);
+    uint32_t node = 0;
+    for (const auto &part : parts) {
+        auto it = children.find({node, part});
+        if (it != children.end()) {
+            node = it->second;
+        } else {
+            uint32_t child = folderIds.size();
+            folderIds.push_back(noFolder);
+            children[{node, part}] = child;
+            node = child;
+        }
+    }
+    folderIds[node] = folderId;
+}
+
+
+void HistoryFolderTreeClass::Ancestors(const std::string_view &folder, std::vector<Ancestor> &res) const
+{
+    // walk down as far as the tree goes, the folders found are then reversed
+    res.clear();
+    std::vector<std::string_view> parts;
+    SplitPath(folder, parts);
+    uint32_t node = 0;
+    int depth = 0;
+    while (true) {
+        if (folderIds[node] != noFolder) {
+            res.push_back({folderIds[node], int(parts.size()) - depth});
+        }
+        if (depth == int(parts.size())) {
+            break;
+        }
+        auto it = children.find({node, parts[depth]});
+        if (it == children.end()) {
+            break;
+        }
+        node = it->second;
+        depth++;
+    }
+    std::reverse(res.begin(), res.end());
+}
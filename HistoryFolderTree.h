@@ -0,0 +1,56 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2024, John Burnell
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  HistoryFolderTree.h
+  Trie of the history folders by path component
+-----------------------------------------------------------------------------*/
+
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+class HistoryFolderTreeClass {
+    // A node for each path component of the folders added, the nodes of the
+    // folders themselves hold their folder ids. A child is found by a hash of
+    // (parent node, component), so finding the folders above a path is one
+    // probe per level however many folders there are.
+    // Components point into the folder names, which must outlive the tree.
+public:
+    static constexpr uint32_t noFolder = 0xFFFFFFFF;
+
+    struct Ancestor {
+        uint32_t folderId;
+        int distance;            // levels up from the folder looked for
+    };
+
+protected:
+    struct ChildHash {
+        size_t operator()(const std::pair<uint32_t, std::string_view> &p) const {
+            return std::hash<std::string_view>()(p.second) * 31 + p.first;
+        }
+    };
+    std::vector<uint32_t> folderIds;        // by node, nodes[0] is the root
+    std::unordered_map<std::pair<uint32_t, std::string_view>, uint32_t, ChildHash> children;
+
+public:
+    HistoryFolderTreeClass();
+
+    void Clear();
+    void Add(const std::string_view &folder, const uint32_t folderId);
+
+    // the folders added that are folder or contain it, nearest first
+    void Ancestors(const std::string_view &folder, std::vector<Ancestor> &res) const;
+
+    // the non empty components of a path
+    static void SplitPath(const std::string_view &folder, std::vector<std::string_view> &parts);
+
+    size_t NoNodes() const {return folderIds.size();}
+};
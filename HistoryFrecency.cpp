@@ -0,0 +1,80 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2024, John Burnell
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  HistoryFrecency.cpp
+  Frecency scores of history commands, globally and per folder
+-----------------------------------------------------------------------------*/
+
+#include <algorithm>
+#include <cmath>
+
+#include "HistoryFrecency.h"
+#include "HistoryFile.h"
+
+
+HistoryFrecencyClass::HistoryFrecencyClass()
+{
+    SetHalfLife(72.0);
+}
+
+
+void HistoryFrecencyClass::SetHalfLife(const double hours)
+{
+    rate = std::log(2.0) / (std::max(hours, 0.01) * 3600.0);
+}
+
+
+void HistoryFrecencyClass::Clear()
+{
+    globalScores.Clear();
+    folderScores.Clear();
+}
+
+
+void HistoryFrecencyClass::Resize(const size_t n)
+{
+    for (size_t i = globalScores.Size(); i < n; i++) {
+        globalScores.Add(noScore);
+        folderScores.Add(noScore);
+    }
+}
+
+
+float HistoryFrecencyClass::Use(const float prev, const int64_t time, const uint32_t flags, const float recWeight) const
+{
+    double weight = recWeight > 0 ? recWeight : HistoryFileClass::Uses(flags);
+    if (flags & HistoryFileClass::failedFlag) {
+        weight *= failedWeight;
+    }
+    return Merge(prev, std::log(weight) + rate * double(time - epoch));
+}
+
+
+float HistoryFrecencyClass::Merge(const float a, const float b)
+{
+    if (a == noScore or b == noScore) {
+        return a == noScore ? b : a;
+    }
+    // log(exp(a) + exp(b)) without overflow
+    double hi = std::max(a, b);
+    double lo = std::min(a, b);
+    return hi + std::log1p(std::exp(lo - hi));
+}
+
+
+double HistoryFrecencyClass::Current(const float score, const int64_t now) const
+{
+    if (score == noScore) {
+        return 0.0;
+    }
+    return std::exp(double(score) - rate * double(now - epoch));
+}
+
+
+double HistoryFrecencyClass::Decay(const int64_t age) const
+{
+    return std::exp(-rate * double(age));
+}
@@ -0,0 +1,77 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2024, John Burnell
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  HistoryFrecency.h
+  Frecency scores of history commands, globally and per folder
+-----------------------------------------------------------------------------*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <limits>
+
+#include "HistoryArray.h"
+
+
+class HistoryFrecencyClass {
+    // The frecency of a command is the sum over its uses of w * 2^-(age/halfLife),
+    // w being smaller for a command that failed. Rather than the sum, the log
+    // of the sum scaled to a fixed epoch, log(sum w * 2^((t - epoch)/halfLife)),
+    // is stored. It does not change as time passes, all scores decay by the
+    // same factor, so decay is only applied when a score is shown and a new
+    // use just adds to the score of the previous use of the command.
+    // Scores are kept for each entry, of the command over all folders and in
+    // the entry's folder. Another thread can read an entry's scores once the
+    // entry has been passed to it, for instance through a trie. The score of
+    // a command's newest entry is raised when its older uses are loaded, so
+    // the scores are atomic.
+public:
+    static constexpr int64_t epoch = 1704067200;     // 2024-01-01
+    static constexpr float noScore = -std::numeric_limits<float>::infinity();
+    static constexpr float failedWeight = 0.2f;
+    static constexpr float folderAffinity = 1.3863f;  // log(4), a use in the folder is worth 4 elsewhere
+    static constexpr float folderDistance = 0.2877f;  // log(4/3), taken off the affinity each level up
+
+protected:
+    double rate;                          // log(2) / halfLife seconds
+    HistoryArrayClass<std::atomic<float>> globalScores;
+    HistoryArrayClass<std::atomic<float>> folderScores;
+
+public:
+    HistoryFrecencyClass();
+
+    // set before any scores are added
+    void SetHalfLife(const double hours);
+
+    // only when nothing is reading
+    void Clear();
+    void Resize(const size_t n);
+
+    // the score after a use at time with the record flags and weight (0 for
+    // its uses), prev is the score before it or noScore
+    float Use(const float prev, const int64_t time, const uint32_t flags, const float weight=0) const;
+
+    // the score of the uses of both
+    static float Merge(const float a, const float b);
+
+    void SetGlobal(const uint32_t ind, const float score) {globalScores[ind].store(score, std::memory_order_relaxed);}
+    void SetFolder(const uint32_t ind, const float score) {folderScores[ind].store(score, std::memory_order_relaxed);}
+    float Global(const uint32_t ind) const {
+        return ind < globalScores.Size() ? globalScores[ind].load(std::memory_order_relaxed) : noScore;
+    }
+    float Folder(const uint32_t ind) const {
+        return ind < folderScores.Size() ? folderScores[ind].load(std::memory_order_relaxed) : noScore;
+    }
+
+    // the decayed score at time now, in weighted uses
+    double Current(const float score, const int64_t now) const;
+
+    // what a use is worth age seconds later
+    double Decay(const int64_t age) const;
+
+    size_t MemoryUsage() const {return globalScores.MemoryUsage() + folderScores.MemoryUsage();}
+};
@@ -0,0 +1,418 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2024, John Burnell
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  HistoryFuzzy.cpp
+  Fuzzy search of the history commands
+-----------------------------------------------------------------------------*/
+
+#include <algorithm>
+#include <cstring>
+
+#include "HistoryFuzzy.h"
+#include "Utilities.h"
+
+#if defined(AVX2_DISPATCH) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+
+static inline char Fold(const char c)
+{
+    return (c >= 'A' and c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+
+static inline bool IsUpper(const char c)
+{
+    return c >= 'A' and c <= 'Z';
+}
+
+
+static inline bool IsDigit(const char c)
+{
+    return c >= '0' and c <= '9';
+}
+
+
+static int Bonus(const std::string_view &cmd, const size_t i)
+{
+    // matches that start words are worth more
+    if (i == 0) {
+        return 10;
+    }
+    char prev = cmd[i-1];
+    char cur = cmd[i];
+    if (prev == ' ' or prev == '/' or prev == '\\' or prev == '\t') {
+        return 10;
+    }
+    if (prev == '-' or prev == '_' or prev == '.' or prev == ':' or prev == '=' or prev == ',' or
+        prev == ';' or prev == '\'' or prev == '"' or prev == '(' or prev == '$') {
+        return 9;
+    }
+    if ((prev >= 'a' and prev <= 'z' and IsUpper(cur)) or (!IsDigit(prev) and IsDigit(cur))) {
+        return 7;
+    }
+    return 0;
+}
+
+
+HistoryFuzzyClass::HistoryFuzzyClass()
+{
+    noThreads = 1;
+    Clear();
+}
+
+
+void HistoryFuzzyClass::Clear()
+{
+    text.clear();
+    folded.clear();
+    starts.assign(1, 0);
+    entries.clear();
+    masks.clear();
+    noLive = 0;
+    increasing = true;
+    sorted.clear();
+    lastQuery.clear();
+    lastSlots.clear();
+    lastValid = false;
+}
+
+
+uint64_t HistoryFuzzyClass::CharMask(const std::string_view &st)
+{
+    // a bit for each letter and digit, other characters share the rest
+    uint64_t mask = 0;
+    for (char ch : st) {
+        char c = Fold(ch);
+        if (c >= 'a' and c <= 'z') {
+            mask |= uint64_t(1) << (c - 'a');
+        } else if (IsDigit(c)) {
+            mask |= uint64_t(1) << (26 + c - '0');
+        } else {
+            mask |= uint64_t(1) << (36 + uint8_t(c) % 28);
+        }
+    }
+    return mask;
+}
+
+
+void HistoryFuzzyClass::Add(const std::string_view &cmd, const uint32_t entry)
+{
+    text.append(cmd);
+    size_t start = folded.size();
+    folded.append(cmd);
+    std::transform(folded.begin() + start, folded.end(), folded.begin() + start, Fold);
+    starts.push_back(text.size());
+    // once entries are out of order they are searched in sorted, which new
+    // entries usually extend, otherwise it is sorted again by Remove
+    if (increasing) {
+        increasing = entries.empty() or entry > entries.back();
+    } else if (sorted.size() == entries.size() and (sorted.empty() or entry > sorted.back().first)) {
+        sorted.push_back({entry, uint32_t(entries.size())});
+    }
+    entries.push_back(entry);
+    masks.push_back(CharMask(cmd));
+    noLive++;
+    lastValid = false;
+}
+
+
+void HistoryFuzzyClass::Remove(const uint32_t entry)
+{
+    // a removed command has an empty mask so is never a candidate
+    size_t slot;
+    if (increasing) {
+        auto it = std::lower_bound(entries.begin(), entries.end(), entry);
+        if (it == entries.end() or *it != entry) {
+            return;
+        }
+        slot = it - entries.begin();
+    } else {
+        if (sorted.size() != entries.size()) {
+            sorted.clear();
+            sorted.reserve(entries.size());
+            for (size_t i = 0; i < entries.size(); i++) {
+                sorted.push_back({entries[i], uint32_t(i)});
+            }
+            std::sort(sorted.begin(), sorted.end());
+        }
+        auto it = std::lower_bound(sorted.begin(), sorted.end(), std::make_pair(entry, uint32_t(0)));
+        if (it == sorted.end() or it->first != entry) {
+            return;
+        }
+        slot = it->second;
+    }
+    if (masks[slot] == 0) {
+        return;
+    }
+    masks[slot] = 0;
+    noLive--;
+    lastValid = false;
+    if (entries.size() > 1024 and entries.size() > 2*noLive) {
+        Compact();
+    }
+}
+
+
+void HistoryFuzzyClass::Compact()
+{
+    std::string newText, newFolded;
+    std::vector<uint32_t> newStarts(1, 0), newEntries;
+    std::vector<uint64_t> newMasks;
+    newText.reserve(text.size() / 2);
+    newFolded.reserve(text.size() / 2);
+    for (size_t slot = 0; slot < entries.size(); slot++) {
+        if (masks[slot] != 0) {
+            newText.append(text, starts[slot], starts[slot+1]-starts[slot]);
+            newFolded.append(folded, starts[slot], starts[slot+1]-starts[slot]);
+            newStarts.push_back(newText.size());
+            newEntries.push_back(entries[slot]);
+            newMasks.push_back(masks[slot]);
+        }
+    }
+    text.swap(newText);
+    folded.swap(newFolded);
+    starts.swap(newStarts);
+    entries.swap(newEntries);
+    masks.swap(newMasks);
+    noLive = entries.size();
+    increasing = std::is_sorted(entries.begin(), entries.end());
+    sorted.clear();
+}
+
+
+#ifdef AVX2_DISPATCH
+// the masks from 0 with all of qMask's bits 4 at a time, returns where it stopped
+AVX2_TARGET static size_t PrefilterAVX2(const uint64_t *m, const size_t n, const uint64_t qMask,
+                                        std::vector<uint32_t> &slots)
+{
+    size_t i = 0;
+    const __m256i q4 = _mm256_set1_epi64x(qMask);
+    for (; i + 4 <= n; i += 4) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(m+i));
+        __m256i hit = _mm256_cmpeq_epi64(_mm256_and_si256(v, q4), q4);
+        int bits = _mm256_movemask_pd(_mm256_castsi256_pd(hit));
+        while (bits != 0) {
+            slots.push_back(i + __builtin_ctz(bits));
+            bits &= bits - 1;
+        }
+    }
+    return i;
+}
+#endif
+
+
+void HistoryFuzzyClass::Prefilter(const uint64_t qMask, std::vector<uint32_t> &slots) const
+{
+    // the slots whose command has all the query's characters
+    size_t n = masks.size();
+    const uint64_t *m = masks.data();
+    size_t i = 0;
+#ifdef AVX2_DISPATCH
+    if (Utilities::HasAVX2()) {
+        i = PrefilterAVX2(m, n, qMask, slots);
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128i q2 = _mm_set1_epi64x(qMask);
+    for (; i + 2 <= n; i += 2) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(m+i));
+        __m128i hit = _mm_cmpeq_epi32(_mm_and_si128(v, q2), q2);
+        // both halves of each 64 bit mask must be equal
+        hit = _mm_and_si128(hit, _mm_shuffle_epi32(hit, _MM_SHUFFLE(2, 3, 0, 1)));
+        int bits = _mm_movemask_pd(_mm_castsi128_pd(hit));
+        while (bits != 0) {
+            slots.push_back(i + __builtin_ctz(bits));
+            bits &= bits - 1;
+        }
+    }
+#endif
+    for (; i < n; i++) {
+        if ((m[i] & qMask) == qMask) {
+            slots.push_back(i);
+        }
+    }
+}
+
+
+int HistoryFuzzyClass::Score(const std::string_view &cmd, const std::string_view &query, const bool caseSensitive)
+{
+    if (caseSensitive) {
+        return Score(cmd, cmd, query);
+    }
+    std::string folded(cmd);
+    std::transform(folded.begin(), folded.end(), folded.begin(), Fold);
+    return Score(cmd, folded, query);
+}
+
+
+int HistoryFuzzyClass::Score(const std::string_view &cmd, const std::string_view &match, const std::string_view &query)
+{
+    // match is cmd, folded if the query is, and is what the query is found in
+    if (query.empty()) {
+        return 0;
+    }
+
+    // the first match going forward, then the shortest one ending there
+    const char *base = match.data();
+    const char *p = base;
+    const char *last = base + match.size();
+    for (char q : query) {
+        p = static_cast<const char*>(std::memchr(p, q, last - p));
+        if (p == nullptr) {
+            return -1;
+        }
+        p++;
+    }
+    size_t end = p - base;
+    size_t start = end;
+    for (size_t qi = query.size(); qi > 0; qi--) {
+        start--;
+        while (match[start] != query[qi-1]) {
+            start--;
+        }
+    }
+
+    int score = 0;
+    int runBonus = 0;
+    bool inGap = false;
+    size_t qi = 0;
+    for (size_t i = start; i < end; i++) {
+        if (qi < query.size() and match[i] == query[qi]) {
+            int bonus = Bonus(cmd, i);
+            if (qi == 0) {
+                bonus *= 2;
+            }
+            // a run keeps the bonus of its first character
+            if (!inGap and qi > 0) {
+                runBonus = std::max(runBonus, bonus);
+                score += 16 + std::max(runBonus, 4);
+            } else {
+                runBonus = bonus;
+                score += 16 + bonus;
+            }
+            inGap = false;
+            qi++;
+        } else {
+            score -= inGap ? 1 : 3;
+            inGap = true;
+        }
+    }
+    return score;
+}
+
+
+void HistoryFuzzyClass::Search(const std::string_view &query, const size_t max, std::vector<Match> &res)
+{
+    res.clear();
+    bool caseSensitive = std::any_of(query.begin(), query.end(), IsUpper);
+    std::string q(query);
+    if (!caseSensitive) {
+        std::transform(q.begin(), q.end(), q.begin(), Fold);
+    }
+
+    if (q.empty()) {
+        for (size_t slot = entries.size(); slot > 0 and res.size() < max; slot--) {
+            if (masks[slot-1] != 0) {
+                res.push_back({entries[slot-1], 0});
+            }
+        }
+        return;
+    }
+
+    std::vector<uint32_t> slots;
+    bool narrow = lastValid and !lastQuery.empty() and q.compare(0, lastQuery.size(), lastQuery) == 0 and
+                  std::any_of(lastQuery.begin(), lastQuery.end(), IsUpper) == caseSensitive;
+    uint64_t qMask = CharMask(q);
+    if (narrow) {
+        slots.reserve(lastSlots.size());
+        for (uint32_t slot : lastSlots) {
+            if ((masks[slot] & qMask) == qMask) {
+                slots.push_back(slot);
+            }
+        }
+    } else {
+        Prefilter(qMask, slots);
+    }
+
+    // chunks are matched in parallel, each keeps its matching slots and best
+    // max, then they are joined in order
+    const size_t chunkSize = 32*1024;
+    size_t noChunks = (slots.size() + chunkSize - 1) / chunkSize;
+    std::vector<std::vector<uint32_t>> matched(noChunks);
+    std::vector<std::vector<Match>> best(noChunks);
+    std::vector<std::function<void()>> tasks;
+    for (size_t c = 0; c < noChunks; c++) {
+        tasks.push_back([&, c]() {
+            size_t first = c*chunkSize;
+            size_t last = std::min(first + chunkSize, slots.size());
+            MatchSlots(slots.data() + first, last - first, q, caseSensitive, max, matched[c], best[c]);
+        });
+    }
+    Utilities::RunTasks(tasks, noThreads);
+
+    lastSlots.clear();
+    for (size_t c = 0; c < noChunks; c++) {
+        lastSlots.insert(lastSlots.end(), matched[c].begin(), matched[c].end());
+        res.insert(res.end(), best[c].begin(), best[c].end());
+    }
+    lastQuery = q;
+    lastValid = true;
+
+    std::sort(res.begin(), res.end(), Better);
+    if (res.size() > max) {
+        res.resize(max);
+    }
+    for (auto &m : res) {
+        m.entry = entries[m.entry];
+    }
+}
+
+
+bool HistoryFuzzyClass::Better(const Match &a, const Match &b)
+{
+    return a.score > b.score or (a.score == b.score and a.entry > b.entry);
+}
+
+
+void HistoryFuzzyClass::MatchSlots(const uint32_t *slots, const size_t n, const std::string &q, 
+                                   const bool caseSensitive, const size_t max,
+                                   std::vector<uint32_t> &matched, std::vector<Match> &best) const
+{
+    // best is a heap with the worst of the best max at the front, newer
+    // commands get up to 32 more so are looked at first to fill it sooner
+    const double recency = 32.0 / std::max(size_t(1), entries.size());
+    size_t noMatched = matched.size();
+    for (size_t i = n; i > 0; i--) {
+        uint32_t slot = slots[i-1];
+        size_t len = starts[slot+1] - starts[slot];
+        std::string_view cmd(text.data() + starts[slot], len);
+        int score = Score(cmd, caseSensitive ? cmd : std::string_view(folded.data() + starts[slot], len), q);
+        if (score < 0) {
+            continue;
+        }
+        matched.push_back(slot);
+        Match m = {slot, score + int(slot * recency)};
+        if (best.size() < max) {
+            best.push_back(m);
+            std::push_heap(best.begin(), best.end(), Better);
+        } else if (max > 0 and Better(m, best.front())) {
+            std::pop_heap(best.begin(), best.end(), Better);
+            best.back() = m;
+            std::push_heap(best.begin(), best.end(), Better);
+        }
+    }
+    std::reverse(matched.begin() + noMatched, matched.end());
+}
+
+
+size_t HistoryFuzzyClass::MemoryUsage() const
+{
+    return text.capacity() + folded.capacity() + starts.capacity()*sizeof(uint32_t) + entries.capacity()*sizeof(uint32_t) +
+           masks.capacity()*sizeof(uint64_t) + lastSlots.capacity()*sizeof(uint32_t) +
+           sorted.capacity()*sizeof(sorted[0]);
+}
@@ -0,0 +1,80 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2024, John Burnell
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  HistoryFuzzy.h
+  Fuzzy search of the history commands
+-----------------------------------------------------------------------------*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+
+class HistoryFuzzyClass {
+    // Commands are copied one after another into a single buffer, with a mask
+    // of the characters each contains. A search first compares the masks with
+    // the query's, several at a time, then matches the query as a subsequence
+    // of the remaining commands and scores the match the way fzf does:
+    // characters at word starts and camelCase humps, and runs of matched
+    // characters, score more, gaps score less and newer commands get a boost.
+    // A query that extends the last one only looks at the last one's matches.
+public:
+    struct Match {
+        uint32_t entry;
+        int score;
+    };
+
+protected:
+    std::string text;                   // commands one after another
+    std::string folded;                 // text in lower case
+    std::vector<uint32_t> starts;       // slot -> start in text, with the end last
+    std::vector<uint32_t> entries;      // slot -> entry
+    std::vector<uint64_t> masks;        // slot -> characters in the command, 0 once replaced
+    size_t noLive;
+    bool increasing;                    // whether entries are, so can be searched
+    std::vector<std::pair<uint32_t, uint32_t>> sorted;  // entry and slot by entry, when not
+
+    std::string lastQuery;
+    std::vector<uint32_t> lastSlots;    // slots matching lastQuery
+    bool lastValid;
+    int noThreads;
+
+    static uint64_t CharMask(const std::string_view &st);
+    void Prefilter(const uint64_t qMask, std::vector<uint32_t> &slots) const;
+    void Compact();
+
+    static int Score(const std::string_view &cmd, const std::string_view &match, const std::string_view &query);
+    static bool Better(const Match &a, const Match &b);
+    void MatchSlots(const uint32_t *slots, const size_t n, const std::string &q, const bool caseSensitive,
+                    const size_t max, std::vector<uint32_t> &matched, std::vector<Match> &best) const;
+
+public:
+    HistoryFuzzyClass();
+
+    void Clear();
+    size_t Size() const {return noLive;}
+
+    // threads used for a search
+    void SetThreads(const int n) {noThreads = n;}
+
+    // commands are added oldest first, entries usually increase but older
+    // ones loaded later are newer entries
+    void Add(const std::string_view &cmd, const uint32_t entry);
+    // the entry has been replaced by a newer use of its command
+    void Remove(const uint32_t entry);
+
+    // the best max matches for query, best first
+    void Search(const std::string_view &query, const size_t max, std::vector<Match> &res);
+
+    // the score of cmd for query or -1 if it does not match
+    static int Score(const std::string_view &cmd, const std::string_view &query, const bool caseSensitive);
+
+    size_t MemoryUsage() const;
+};
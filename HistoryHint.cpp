@@ -0,0 +1,132 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2024, John Burnell
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  HistoryHint.cpp
+  Background thread that finds history hints as the input changes
+-----------------------------------------------------------------------------*/
+
+#include <chrono>
+
+#include "HistoryHint.h"
+
+
+HistoryHintClass::HistoryHintClass()
+{
+    generation = 0;
+    resultGen = 0;
+    found = false;
+    stop = false;
+}
+
+
+HistoryHintClass::~HistoryHintClass()
+{
+    Stop();
+}
+
+
+void HistoryHintClass::Start(const NextSource &next)
+{
+    Stop();
+    nextSource = next;
+    stop = false;
+    thread = std::thread(&HistoryHintClass::Run, this);
+}
+
+
+void HistoryHintClass::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lck(mutex);
+        stop = true;
+    }
+    cond.notify_all();
+    if (thread.joinable()) {
+        thread.join();
+    }
+    index.reset();
+}
+
+
+uint64_t HistoryHintClass::Request(const std::string &p, const std::shared_ptr<const HistoryIndexClass> &ind,
+                                   const std::vector<HistoryFolderTreeClass::Ancestor> &f, const std::string &dir)
+{
+    uint64_t gen;
+    {
+        std::lock_guard<std::mutex> lck(mutex);
+        pref = p;
+        index = ind;
+        folders = f;
+        folder = dir;
+        gen = ++generation;
+    }
+    cond.notify_one();
+    return gen;
+}
+
+
+bool HistoryHintClass::Wait(const uint64_t gen, const int waitMS, bool &hasHint, std::string &hint)
+{
+    std::unique_lock<std::mutex> lck(mutex);
+    if (!doneCond.wait_for(lck, std::chrono::milliseconds(waitMS), [this, gen]() {return resultGen >= gen;})) {
+        return false;
+    }
+    if (resultGen != gen) {
+        // a later request has been answered
+        return false;
+    }
+    hasHint = found;
+    hint = result;
+    return true;
+}
+
+
+bool HistoryHintClass::Latest(std::string &p, bool &hasHint, std::string &hint)
+{
+    std::lock_guard<std::mutex> lck(mutex);
+    if (resultGen == 0) {
+        return false;
+    }
+    p = resultPref;
+    hasHint = found;
+    hint = result;
+    return true;
+}
+
+
+void HistoryHintClass::Run()
+{
+    std::unique_lock<std::mutex> lck(mutex);
+    while (true) {
+        cond.wait(lck, [this]() {return stop or generation > resultGen;});
+        if (stop) {
+            return;
+        }
+        // only the newest request is looked up
+        uint64_t gen = generation;
+        std::string p = pref;
+        std::shared_ptr<const HistoryIndexClass> ind = std::move(index);
+        std::vector<HistoryFolderTreeClass::Ancestor> f = std::move(folders);
+        std::string dir = folder;
+        lck.unlock();
+
+        std::string hint;
+        bool ok = ind->FindHint(p, f, hint);
+        // the last reader of an index replaced by a reload frees it
+        ind.reset();
+        if (!ok and nextSource) {
+            ok = nextSource(p, dir, hint);
+        }
+
+        // a superseded result is still the newest there is
+        lck.lock();
+        found = ok;
+        result.swap(hint);
+        resultPref = p;
+        resultGen = gen;
+        doneCond.notify_all();
+    }
+}
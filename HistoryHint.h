@@ -0,0 +1,77 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2024, John Burnell
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  HistoryHint.h
+  Background thread that finds history hints as the input changes
+-----------------------------------------------------------------------------*/
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+#include "HistoryIndex.h"
+
+
+class HistoryHintClass {
+    // Each Request gets the next generation and supersedes those before it,
+    // a request that has not started is never looked up. The result of one
+    // that has is kept as the newest result, for a key that cannot wait for
+    // its own. Hints are found in the history's index, which the shell goes
+    // on adding to while it is read, and failing that from the next token
+    // source. The mutex only guards the request and the result, it is never
+    // held during a lookup.
+public:
+    // line with its likeliest next token for folder, if there is one
+    typedef std::function<bool(const std::string &line, const std::string &folder, std::string &hint)> NextSource;
+
+protected:
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::condition_variable doneCond;
+    uint64_t generation;             // of the newest request
+    std::string pref;
+    std::shared_ptr<const HistoryIndexClass> index;
+    std::vector<HistoryFolderTreeClass::Ancestor> folders;
+    std::string folder;
+    NextSource nextSource;
+    uint64_t resultGen;              // of the request result is for
+    std::string resultPref;
+    bool found;
+    std::string result;
+    bool stop;
+    std::thread thread;
+
+    void Run();
+
+public:
+    HistoryHintClass();
+    ~HistoryHintClass();
+
+    void Start(const NextSource &next=nullptr);
+    void Stop();
+    bool IsRunning() const {return thread.joinable();}
+
+    // ask for the hint for pref from the index and folders, as given by the
+    // history's GetIndex and FindFolders, in the current folder. Returns the
+    // request's generation
+    uint64_t Request(const std::string &pref, const std::shared_ptr<const HistoryIndexClass> &index,
+                     const std::vector<HistoryFolderTreeClass::Ancestor> &folders, const std::string &folder);
+
+    // Wait up to waitMS for the result of gen. Returns true when it is done,
+    // with found set if there is a hint
+    bool Wait(const uint64_t gen, const int waitMS, bool &found, std::string &hint);
+
+    // the newest result, of pref, which may be of an earlier request.
+    // Returns false if there is none
+    bool Latest(std::string &pref, bool &found, std::string &hint);
+};
@@ -0,0 +1,60 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2024, John Burnell
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  HistoryIndex.cpp
+  The loaded history that hints are found from
+-----------------------------------------------------------------------------*/
+
+#include "HistoryIndex.h"
+
+
+HistoryIndexClass::HistoryIndexClass()
+{
+    // folder 0 has no trie, commands without a folder are only in allTrie
+    folderTries.Resize(1);
+}
+
+
+bool HistoryIndexClass::FindHint(const std::string &pref, const std::vector<HistoryFolderTreeClass::Ancestor> &folders,
+                                 std::string &hint) const
+{
+    // The tries give the best match globally and in each folder from folder
+    // up. A folder's match has its score raised by an affinity that falls
+    // with each level up, once it is gone a folder's match cannot beat the
+    // global one, whose score is at least its score in any folder
+    uint32_t ind = allTrie.Find(pref);
+    float best = frecency.Global(ind);
+    for (const auto &anc : folders) {
+        float affinity = HistoryFrecencyClass::folderAffinity - anc.distance * HistoryFrecencyClass::folderDistance;
+        if (affinity <= 0.0f) {
+            break;
+        }
+        if (anc.folderId >= folderTries.Size()) {
+            continue;
+        }
+        uint32_t folderInd = folderTries[anc.folderId].Find(pref);
+        if (folderInd != HistoryTrieClass::noEntry and frecency.Folder(folderInd) + affinity >= best) {
+            ind = folderInd;
+            best = frecency.Folder(folderInd) + affinity;
+        }
+    }
+    if (ind == HistoryTrieClass::noEntry) {
+        std::string_view cmd;
+        if (cold.FindHint(pref, cmd)) {
+            hint = cmd;
+            return true;
+        }
+        return false;
+    }
+    hint = store.Cmd(ind);
+    return true;
+}
+
+
+size_t HistoryIndexClass::MemoryUsage() const
+{
+    return store.MemoryUsage() + frecency.MemoryUsage() + cold.MemoryUsage();
+}
@@ -0,0 +1,48 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2024, John Burnell
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  HistoryIndex.h
+  The loaded history that hints are found from
+-----------------------------------------------------------------------------*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "HistoryArray.h"
+#include "HistoryCold.h"
+#include "HistoryFile.h"
+#include "HistoryFolderTree.h"
+#include "HistoryFrecency.h"
+#include "HistoryStore.h"
+#include "HistoryTrie.h"
+
+
+class HistoryIndexClass {
+    // The mapped file, the entries, their frecency and the prefix tries. The
+    // shell adds entries while other threads find hints in it, with no locks
+    // on either side as each part is safe for one writer and many readers.
+    // It is replaced rather than cleared, so a reader holding a shared_ptr to
+    // the old one can finish with it.
+public:
+    HistoryFileClass file;                           // loaded commands point into its mapping
+    HistoryStoreClass store;
+    HistoryFrecencyClass frecency;
+    HistoryTrieClass allTrie;
+    HistoryArrayClass<HistoryTrieClass> folderTries; // by folder id, ranked by the folder frecency
+    HistoryColdClass cold;                           // the records before the loaded window
+
+    HistoryIndexClass();
+
+    // The command starting with pref with the highest frecency in the folders,
+    // nearest first, less for each level up, or globally if one there is used
+    // much more. Can be called from any thread
+    bool FindHint(const std::string &pref, const std::vector<HistoryFolderTreeClass::Ancestor> &folders,
+                  std::string &hint) const;
+
+    size_t MemoryUsage() const;
+};
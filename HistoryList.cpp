@@ -0,0 +1,222 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2024, John Burnell
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  HistoryList.cpp
+  Ordered, de-duplicated list of history entries
+-----------------------------------------------------------------------------*/
+
+#include <algorithm>
+#include <iterator>
+
+#include "HistoryList.h"
+
+
+HistoryListClass::HistoryListClass()
+{
+    noLive = 0;
+}
+
+
+void HistoryListClass::Clear()
+{
+    slots.clear();
+    tree.clear();
+    lookup.clear();
+    noLive = 0;
+}
+
+
+void HistoryListClass::Reserve(const size_t n)
+{
+    slots.reserve(n);
+    tree.reserve(n);
+    lookup.reserve(n);
+}
+
+
+void HistoryListClass::TreeAdd(size_t slot, const int val)
+{
+    for (size_t i = slot+1; i <= tree.size(); i += i & (~i+1)) {
+        tree[i-1] += val;
+    }
+}
+
+
+uint32_t HistoryListClass::TreeSum(size_t n) const
+{
+    // number of live slots in the first n
+    uint32_t sum = 0;
+    for (size_t i = n; i > 0; i -= i & (~i+1)) {
+        sum += tree[i-1];
+    }
+    return sum;
+}
+
+
+uint32_t HistoryListClass::Add(const std::string_view &cmd, const uint32_t entry)
+{
+    uint32_t old = noEntry;
+    auto it = lookup.find(cmd);
+    if (it != lookup.end()) {
+        uint32_t slot = it->second;
+        old = slots[slot];
+        slots[slot] = noEntry;
+        TreeAdd(slot, -1);
+        noLive--;
+    }
+
+    // the new Fenwick node covers (i-lowbit(i), i]
+    slots.push_back(entry);
+    size_t i = slots.size();
+    size_t low = i & (~i+1);
+    tree.push_back(1 + TreeSum(i-1) - TreeSum(i-low));
+    noLive++;
+    // the key refers to the newest entry's text
+    if (it != lookup.end()) {
+        lookup.erase(it);
+    }
+    lookup[cmd] = i-1;
+
+    if (slots.size() > 1024 and slots.size() > 2*noLive) {
+        Compact();
+    }
+    return old;
+}
+
+
+void HistoryListClass::AddOlder(std::vector<std::pair<std::string_view, uint32_t>> ents,
+                                const std::function<bool(const uint32_t a, const uint32_t b)> &before)
+{
+    // the commands of the slots, less those being replaced
+    std::vector<std::string_view> cmds(slots.size());
+    for (const auto &it : lookup) {
+        cmds[it.second] = it.first;
+    }
+    std::vector<bool> replaced(slots.size());
+    for (const auto &ent : ents) {
+        auto it = lookup.find(ent.first);
+        if (it != lookup.end()) {
+            replaced[it->second] = true;
+        }
+    }
+    std::vector<std::pair<std::string_view, uint32_t>> kept;
+    kept.reserve(noLive);
+    for (size_t i = 0; i < slots.size(); i++) {
+        if (slots[i] != noEntry and !replaced[i]) {
+            kept.push_back({cmds[i], slots[i]});
+        }
+    }
+
+    auto order = [&before](const auto &a, const auto &b) {return before(a.second, b.second);};
+    std::stable_sort(ents.begin(), ents.end(), order);
+    std::vector<std::pair<std::string_view, uint32_t>> all;
+    all.reserve(kept.size() + ents.size());
+    std::merge(kept.begin(), kept.end(), ents.begin(), ents.end(), std::back_inserter(all), order);
+
+    Clear();
+    Reserve(all.size());
+    for (const auto &ent : all) {
+        Add(ent.first, ent.second);
+    }
+}
+
+
+void HistoryListClass::Compact()
+{
+    std::vector<uint32_t> live;
+    live.reserve(noLive);
+    for (uint32_t ent : slots) {
+        if (ent != noEntry) {
+            live.push_back(ent);
+        }
+    }
+
+    // slots move, so update the lookup
+    std::vector<uint32_t> newSlot(slots.size(), noEntry);
+    uint32_t n = 0;
+    for (size_t i = 0; i < slots.size(); i++) {
+        if (slots[i] != noEntry) {
+            newSlot[i] = n++;
+        }
+    }
+    for (auto &it : lookup) {
+        it.second = newSlot[it.second];
+    }
+
+    slots.swap(live);
+    tree.assign(slots.size(), 0);
+    for (size_t i = 1; i <= tree.size(); i++) {
+        tree[i-1] += 1;
+        size_t parent = i + (i & (~i+1));
+        if (parent <= tree.size()) {
+            tree[parent-1] += tree[i-1];
+        }
+    }
+}
+
+
+uint32_t HistoryListClass::Get(const size_t n) const
+{
+    if (n >= noLive) {
+        return noEntry;
+    }
+    // find the smallest slot with n+1 live slots up to it
+    size_t pos = 0;
+    uint32_t rem = n + 1;
+    size_t step = 1;
+    while (step*2 <= tree.size()) {
+        step *= 2;
+    }
+    for (; step > 0; step /= 2) {
+        if (pos + step <= tree.size() and tree[pos+step-1] < rem) {
+            pos += step;
+            rem -= tree[pos-1];
+        }
+    }
+    return slots[pos];
+}
+
+
+uint32_t HistoryListClass::Last() const
+{
+    // the newest slot is always live
+    if (slots.empty()) {
+        return noEntry;
+    }
+    return slots.back();
+}
+
+
+uint32_t HistoryListClass::Find(const std::string_view &cmd) const
+{
+    auto it = lookup.find(cmd);
+    if (it == lookup.end()) {
+        return noEntry;
+    }
+    return slots[it->second];
+}
+
+
+uint32_t HistoryListClass::Position(const std::string_view &cmd) const
+{
+    auto it = lookup.find(cmd);
+    if (it == lookup.end()) {
+        return noEntry;
+    }
+    return TreeSum(it->second);
+}
+
+
+void HistoryListClass::GetEntries(std::vector<uint32_t> &ents) const
+{
+    ents.clear();
+    ents.reserve(noLive);
+    for (uint32_t ent : slots) {
+        if (ent != noEntry) {
+            ents.push_back(ent);
+        }
+    }
+}
@@ -0,0 +1,71 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2024, John Burnell
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  HistoryList.h
+  Ordered, de-duplicated list of history entries
+-----------------------------------------------------------------------------*/
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+class HistoryListClass {
+    // Entries in order of last use, each command appears once. A repeated
+    // command is found by a hash lookup and moved to the end by marking its
+    // old slot dead, a Fenwick tree over the live slots finds the n'th entry
+    // in O(log n). Dead slots are squeezed out once they outnumber live ones.
+    // The keys point at the command text, which must outlive the list.
+public:
+    static constexpr uint32_t noEntry = 0xFFFFFFFF;
+
+protected:
+    std::vector<uint32_t> slots;        // entry indices, noEntry once moved
+    std::vector<uint32_t> tree;         // Fenwick tree of live slots, 1 based
+    std::unordered_map<std::string_view, uint32_t> lookup;    // command -> slot
+    size_t noLive;
+
+    void TreeAdd(size_t slot, const int val);
+    uint32_t TreeSum(size_t n) const;
+    void Compact();
+
+public:
+    HistoryListClass();
+
+    void Clear();
+    void Reserve(const size_t n);
+
+    // Add entry as the newest, returns the entry it replaces or noEntry
+    uint32_t Add(const std::string_view &cmd, const uint32_t entry);
+
+    // Add entries that are not the newest, each replacing the entry of its
+    // command if there is one. The list is rebuilt with all of them in the
+    // order given by before, which the entries in it already follow
+    void AddOlder(std::vector<std::pair<std::string_view, uint32_t>> ents,
+                  const std::function<bool(const uint32_t a, const uint32_t b)> &before);
+
+    size_t Size() const {return noLive;}
+
+    // the n'th entry, 0 is the oldest
+    uint32_t Get(const size_t n) const;
+    uint32_t Last() const;
+
+    // the entry for cmd or noEntry
+    uint32_t Find(const std::string_view &cmd) const;
+    // the place of cmd in the list, as n for Get, or noEntry
+    uint32_t Position(const std::string_view &cmd) const;
+
+    // all entries, oldest first
+    void GetEntries(std::vector<uint32_t> &ents) const;
+
+    // the slots in order, moved entries are noEntry
+    const std::vector<uint32_t> &Slots() const {return slots;}
+};
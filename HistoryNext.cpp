@@ -0,0 +1,526 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2024, John Burnell
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  HistoryNext.cpp
+  Model of the next token of a command, learnt from the history file
+-----------------------------------------------------------------------------*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include <filesystem>
+namespace fs = std::filesystem;
+
+#include "HistoryNext.h"
+
+
+const char HistoryNextClass::magic[8] = {'C', 'R', 'A', 'B', 'N', 'E', 'X', 'T'};
+
+// the token before the first argument, tokens are never empty
+static const std::string_view startMark = "\n";
+
+
+template <typename T>
+static T ReadValue(const char *p)
+{
+    T val;
+    std::memcpy(&val, p, sizeof(T));
+    return val;
+}
+
+
+template <typename T>
+static void WriteValue(std::string &buf, const T val)
+{
+    buf.append(reinterpret_cast<const char*>(&val), sizeof(T));
+}
+
+
+HistoryNextClass::HistoryNextClass()
+{
+    building = false;
+    stopBuild = false;
+    tableOk = false;
+    Clear();
+}
+
+
+HistoryNextClass::~HistoryNextClass()
+{
+    Clear();
+}
+
+
+void HistoryNextClass::Clear()
+{
+    // a table being built is dropped
+    stopBuild = true;
+    if (builder.joinable()) {
+        builder.join();
+    }
+    table.reset();
+    building = false;
+    fileName.clear();
+    ClearCounts();
+}
+
+
+void HistoryNextClass::ClearCounts()
+{
+    added.clear();
+    recent.clear();
+    map.Close();
+    noContexts = 0;
+    noTokens = 0;
+    fileId = 0;
+    endOffset = 0;
+    countedEnd = 0;
+    noUnsaved = 0;
+}
+
+
+uint64_t HistoryNextClass::Key(const std::string_view &folder, const std::string_view &prev2,
+                               const std::string_view &prev1)
+{
+    // FNV-1a of the parts, each ended by a 0
+    uint64_t h = 14695981039346656037ULL;
+    for (const std::string_view *part : {&folder, &prev2, &prev1}) {
+        for (char c : *part) {
+            h = (h ^ uint8_t(c)) * 1099511628211ULL;
+        }
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+
+bool HistoryNextClass::IsSeparator(const std::string &tok)
+{
+    return tok == "|" or tok == ";" or tok == "&" or tok == "&&" or tok == "||";
+}
+
+
+bool HistoryNextClass::Tokens(const std::string &line, std::vector<std::string> &toks, std::vector<int> &starts)
+{
+    // the tokens keep their quotes, returns true if line ends in a blank
+    toks.clear();
+    starts.clear();
+    Utilities::CmdClass cmds;
+    bool lastBlank = cmds.ParseLine(line, false);
+    for (const auto &tok : cmds.GetTokens()) {
+        if (!tok.cmd.empty()) {
+            toks.push_back(tok.cmd);
+            starts.push_back(tok.startPos);
+        }
+    }
+    return lastBlank;
+}
+
+
+void HistoryNextClass::Add(const std::string_view &cmd, const std::string_view &folder, const uint32_t flags)
+{
+    CountCmd(cmd, folder, flags, recent);
+}
+
+
+void HistoryNextClass::CountCmd(const std::string_view &cmd, const std::string_view &folder, const uint32_t flags,
+                                ContextCounts &to)
+{
+    if (flags & HistoryFileClass::failedFlag) {
+        return;
+    }
+    uint32_t n = HistoryFileClass::Uses(flags);
+    std::vector<std::string> toks;
+    std::vector<int> starts;
+    Tokens(std::string(cmd), toks, starts);
+
+    size_t first = 0;        // the command word
+    for (size_t i = 0; i < toks.size(); i++) {
+        if (IsSeparator(toks[i])) {
+            first = i+1;
+            continue;
+        }
+        if (i == first) {
+            continue;
+        }
+        std::string_view prev2 = i-1 == first ? startMark : std::string_view(toks[i-2]);
+        const std::string &prev1 = toks[i-1];
+        uint64_t hash = Key("", "", toks[i]);
+        AddCount(to[Key(folder, prev2, prev1)], toks[i], hash, n);
+        AddCount(to[Key(folder, "", prev1)], toks[i], hash, n);
+        if (!folder.empty()) {
+            AddCount(to[Key("", prev2, prev1)], toks[i], hash, n);
+            AddCount(to[Key("", "", prev1)], toks[i], hash, n);
+        }
+    }
+}
+
+
+void HistoryNextClass::AddCount(std::vector<Count> &counts, const std::string &token, const uint64_t hash,
+                                const uint32_t n)
+{
+    size_t least = 0;
+    for (size_t i = 0; i < counts.size(); i++) {
+        if (counts[i].hash == hash and counts[i].token == token) {
+            counts[i].count += n;
+            return;
+        }
+        if (counts[i].count < counts[least].count) {
+            least = i;
+        }
+    }
+    if (counts.size() < maxCounted) {
+        counts.push_back({hash, token, n});
+    } else {
+        counts[least].hash = hash;
+        counts[least].token = token;
+        counts[least].count += n;
+    }
+}
+
+
+void HistoryNextClass::GetCounts(const uint64_t key, Counts &counts) const
+{
+    counts.clear();
+    if (noContexts > 0) {
+        const char *contexts = map.Data() + headerSize;
+        const char *tokens = contexts + noContexts*contextSize;
+        const char *text = tokens + noTokens*tokenSize;
+        size_t textSize = map.Size() - (text - map.Data());
+        uint64_t lo = 0, hi = noContexts;
+        while (lo < hi) {
+            uint64_t mid = (lo + hi) / 2;
+            if (ReadValue<uint64_t>(contexts + mid*contextSize) < key) {
+                lo = mid+1;
+            } else {
+                hi = mid;
+            }
+        }
+        if (lo < noContexts and ReadValue<uint64_t>(contexts + lo*contextSize) == key) {
+            uint32_t first = ReadValue<uint32_t>(contexts + lo*contextSize + 8);
+            uint32_t count = ReadValue<uint32_t>(contexts + lo*contextSize + 12);
+            for (uint64_t t = first; t < uint64_t(first) + count and t < noTokens; t++) {
+                const char *tok = tokens + t*tokenSize;
+                uint32_t offset = ReadValue<uint32_t>(tok);
+                uint32_t len = ReadValue<uint32_t>(tok+4);
+                if (uint64_t(offset) + len <= textSize) {
+                    counts[std::string(text+offset, len)] += ReadValue<uint32_t>(tok+8);
+                }
+            }
+        }
+    }
+    for (const ContextCounts *from : {&added, &recent}) {
+        auto it = from->find(key);
+        if (it != from->end()) {
+            for (const auto &c : it->second) {
+                counts[c.token] += c.count;
+            }
+        }
+    }
+}
+
+
+bool HistoryNextClass::Predict(const std::string &line, const std::string &folder, const size_t max,
+                               std::vector<std::string> &res, size_t &start) const
+{
+    res.clear();
+    std::vector<std::string> toks;
+    std::vector<int> starts;
+    bool lastBlank = Tokens(line, toks, starts);
+    std::string word;
+    start = line.size();
+    if (!lastBlank and !toks.empty()) {
+        word = toks.back();
+        start = starts.back();
+        toks.pop_back();
+    }
+    if (toks.empty() or IsSeparator(toks.back())) {
+        return false;
+    }
+    size_t first = 0;
+    for (size_t i = 0; i < toks.size(); i++) {
+        if (IsSeparator(toks[i])) {
+            first = i+1;
+        }
+    }
+    std::string_view prev2 = toks.size()-1 == first ? startMark : std::string_view(toks[toks.size()-2]);
+    const std::string &prev1 = toks.back();
+
+    // the most particular contexts first
+    std::vector<uint64_t> keys;
+    if (!folder.empty()) {
+        keys.push_back(Key(folder, prev2, prev1));
+    }
+    keys.push_back(Key("", prev2, prev1));
+    if (!folder.empty()) {
+        keys.push_back(Key(folder, "", prev1));
+    }
+    keys.push_back(Key("", "", prev1));
+
+    Counts counts;
+    std::vector<std::pair<uint32_t, const std::string*>> ranked;
+    for (uint64_t key : keys) {
+        GetCounts(key, counts);
+        ranked.clear();
+        for (const auto &c : counts) {
+            if (c.first.compare(0, word.size(), word) == 0 and c.first.size() > word.size()) {
+                ranked.push_back({c.second, &c.first});
+            }
+        }
+        std::sort(ranked.begin(), ranked.end(), [](const auto &a, const auto &b) {
+            return a.first != b.first ? a.first > b.first : *a.second < *b.second;
+        });
+        for (const auto &r : ranked) {
+            if (res.size() >= max) {
+                return true;
+            }
+            if (std::find(res.begin(), res.end(), *r.second) == res.end()) {
+                res.push_back(*r.second);
+            }
+        }
+    }
+    return !res.empty();
+}
+
+
+bool HistoryNextClass::Update(const std::string &histFile)
+{
+    if (histFile != fileName) {
+        Clear();
+        fileName = histFile;
+        Read(fileName + ".nxt");
+    }
+    if (building) {
+        return true;
+    }
+    if (table) {
+        builder.join();
+        if (tableOk) {
+            Take(*table);
+        }
+        table.reset();
+    }
+
+    // a new table, or many records to catch up with, is left to a thread
+    std::error_code ec;
+    uint64_t size = fs::file_size(fileName, ec);
+    uint64_t id = Utilities::GetFileId(fileName);
+    if (ec or id == 0) {
+        return false;
+    }
+    bool current = id == fileId and countedEnd > 0 and countedEnd <= size;
+    if ((current ? size - countedEnd : size) > maxInline) {
+        StartBuild();
+        return true;
+    }
+    return CatchUp(nullptr);
+}
+
+
+void HistoryNextClass::StartBuild()
+{
+    // the thread starts from the saved table, which may be another shell's
+    table = std::make_unique<HistoryNextClass>();
+    table->fileName = fileName;
+    tableOk = false;
+    stopBuild = false;
+    building = true;
+    builder = std::thread([this]() {
+        table->Read(table->fileName + ".nxt");
+        tableOk = table->CatchUp(&stopBuild);
+        building = false;
+    });
+}
+
+
+void HistoryNextClass::Take(HistoryNextClass &from)
+{
+    map.Swap(from.map);
+    added.swap(from.added);
+    noContexts = from.noContexts;
+    noTokens = from.noTokens;
+    fileId = from.fileId;
+    endOffset = from.endOffset;
+    countedEnd = from.countedEnd;
+    noUnsaved = from.noUnsaved;
+}
+
+
+bool HistoryNextClass::CatchUp(const std::atomic<bool> *stop)
+{
+    std::error_code ec;
+    uint64_t size = fs::file_size(fileName, ec);
+    uint64_t id = Utilities::GetFileId(fileName);
+    if (ec or id == 0) {
+        return false;
+    }
+    if (id != fileId or countedEnd > size) {
+        // replaced, usually compacted, so start again
+        ClearCounts();
+        fileId = id;
+    }
+
+    // the records not yet counted are, in place of the commands added since
+    // the last catch up
+    recent.clear();
+    if (countedEnd > 0 and countedEnd == size) {
+        return true;
+    }
+    HistoryFileClass file;
+    if (!file.Open(fileName)) {
+        return false;
+    }
+    std::vector<HistoryFileClass::Record> recs;
+    uint64_t end;
+    if (countedEnd == 0) {
+        // a new table starts from the newest records of a long history
+        uint64_t noIndexed = file.NoIndexed();
+        file.GetRecords(recs, 1, noIndexed > maxBuilt ? noIndexed - maxBuilt : 0);
+        end = file.ValidEnd();
+    } else {
+        end = HistoryFileClass::Scan(file.Data(), file.Size(), std::max(countedEnd, file.TailStart()), recs);
+    }
+    for (size_t i = 0; i < recs.size(); i++) {
+        if (stop != nullptr and i % 1024 == 0 and *stop) {
+            return false;
+        }
+        CountCmd(recs[i].cmd, recs[i].folder, recs[i].flags, added);
+    }
+    countedEnd = end;
+    noUnsaved += recs.size();
+
+    // the whole table is written, so only once the records after it are a
+    // good part of it
+    if (noUnsaved >= std::max(minSaved, noContexts / 8)) {
+        if (noContexts == 0) {
+            Utilities::LogMessage("Building the next token table of " + fileName);
+        }
+        Save(fileName + ".nxt", end);
+    }
+    return true;
+}
+
+
+bool HistoryNextClass::Save(const std::string &tableName, const uint64_t end)
+{
+    // the table's contexts and those added, each with its most used tokens
+    std::vector<uint64_t> keys;
+    keys.reserve(noContexts + added.size());
+    for (uint64_t c = 0; c < noContexts; c++) {
+        keys.push_back(ReadValue<uint64_t>(map.Data() + headerSize + c*contextSize));
+    }
+    for (const auto &it : added) {
+        keys.push_back(it.first);
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+    std::string contexts, tokens, text;
+    std::unordered_map<std::string, uint32_t> textOffsets;
+    Counts counts;
+    std::vector<std::pair<uint32_t, const std::string*>> ranked;
+    uint32_t noSaved = 0;
+    for (uint64_t key : keys) {
+        GetCounts(key, counts);
+        ranked.clear();
+        for (const auto &c : counts) {
+            ranked.push_back({c.second, &c.first});
+        }
+        size_t n = std::min(ranked.size(), maxTokens);
+        std::partial_sort(ranked.begin(), ranked.begin() + n, ranked.end(), [](const auto &a, const auto &b) {
+            return a.first != b.first ? a.first > b.first : *a.second < *b.second;
+        });
+        WriteValue<uint64_t>(contexts, key);
+        WriteValue<uint32_t>(contexts, noSaved);
+        WriteValue<uint32_t>(contexts, n);
+        for (size_t i = 0; i < n; i++) {
+            auto ins = textOffsets.insert({*ranked[i].second, uint32_t(text.size())});
+            if (ins.second) {
+                text += *ranked[i].second;
+            }
+            WriteValue<uint32_t>(tokens, ins.first->second);
+            WriteValue<uint32_t>(tokens, ranked[i].second->size());
+            WriteValue<uint32_t>(tokens, ranked[i].first);
+        }
+        noSaved += n;
+    }
+
+    uint32_t crc = Utilities::Crc32(contexts.data(), contexts.size());
+    crc = Utilities::Crc32(tokens.data(), tokens.size(), crc);
+    crc = Utilities::Crc32(text.data(), text.size(), crc);
+    std::string buf;
+    buf.append(magic, 8);
+    WriteValue<uint32_t>(buf, version);
+    WriteValue<uint32_t>(buf, crc);
+    WriteValue<uint64_t>(buf, fileId);
+    WriteValue<uint64_t>(buf, end);
+    WriteValue<uint64_t>(buf, keys.size());
+    WriteValue<uint64_t>(buf, noSaved);
+
+    // another shell may be saving too, either copy will do. The new table is
+    // mapped before it is renamed so it is this one
+    std::string tmpName = tableName + ".tmp" +
+                          std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+    if (!Utilities::WriteTempFile(tmpName, {buf, contexts, tokens, text}, false)) {
+        return false;
+    }
+    if (!Read(tmpName)) {
+        std::error_code ec;
+        fs::remove(tmpName, ec);
+        return false;
+    }
+    added.clear();
+    noUnsaved = 0;
+    Utilities::ReplaceFile(tmpName, tableName, false);
+    return true;
+}
+
+
+bool HistoryNextClass::Read(const std::string &tableName)
+{
+    Utilities::MappedFile table;
+    if (!table.Open(tableName)) {
+        return false;
+    }
+    const char *data = table.Data();
+    size_t size = table.Size();
+    if (size < headerSize or std::memcmp(data, magic, 8) != 0 or ReadValue<uint32_t>(data+8) != version or
+        ReadValue<uint32_t>(data+12) != Utilities::Crc32(data+headerSize, size-headerSize)) {
+        Utilities::LogMessage("Next token table " + tableName + " is damaged, rebuilding it");
+        return false;
+    }
+    uint64_t contexts = ReadValue<uint64_t>(data+32);
+    uint64_t tokens = ReadValue<uint64_t>(data+40);
+    if (contexts > size / contextSize or tokens > size / tokenSize or
+        headerSize + contexts*contextSize + tokens*tokenSize > size) {
+        return false;
+    }
+
+    // the mapping checked is the one kept, the file may be replaced by now
+    map.Swap(table);
+    noContexts = contexts;
+    noTokens = tokens;
+    fileId = ReadValue<uint64_t>(data+16);
+    endOffset = ReadValue<uint64_t>(data+24);
+    countedEnd = endOffset;
+    return true;
+}
+
+
+size_t HistoryNextClass::MemoryUsage() const
+{
+    size_t mem = 0;
+    for (const ContextCounts *from : {&added, &recent}) {
+        for (const auto &it : *from) {
+            mem += sizeof(it) + 2*sizeof(void*);
+            for (const auto &c : it.second) {
+                mem += sizeof(c) + c.token.capacity();
+            }
+        }
+    }
+    return mem;
+}
@@ -0,0 +1,126 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2024, John Burnell
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  HistoryNext.h
+  Model of the next token of a command, learnt from the history file
+-----------------------------------------------------------------------------*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "HistoryFile.h"
+
+
+class HistoryNextClass {
+    // Each argument of a history command is counted against its context, the
+    // two tokens before it and the one before it, in the command's folder and
+    // in all folders. A command starts again after a | ; & && or ||. Failed
+    // commands are not counted.
+    // Only the counts of the most used tokens of a context are kept, when a
+    // context has maxCounted the least used is replaced and the new token
+    // takes on its count (space-saving), so a count can be too high by the
+    // count it took on but a token used more than that is always kept.
+    // The counts are saved beside the history file (as .nxt) in a table of
+    // contexts sorted by key, with the most used tokens of each, that is
+    // mapped and searched in place. The counts of records after the table
+    // and of commands added since it was caught up are kept in memory, the
+    // table is only written again once the records after it are a good part
+    // of it, so the cost of a save is spread over many commands.
+    // A new table, or a long catch up, is done on a thread from the saved
+    // table, the counts here are used until it is taken up by Update.
+    //
+    // Table:   "CRABNEXT" u32 version, u32 crc32(rest), u64 fileId, u64 endOffset,
+    //          u64 noContexts, u64 noTokens
+    //          contexts[noContexts] u64 key, u32 first token, u32 count
+    //          tokens[noTokens]     u32 text offset, u32 text length, u32 count
+    //          text
+public:
+    static const char magic[8];
+    static constexpr uint32_t version = 1;
+    static constexpr size_t headerSize = 48;
+    static constexpr size_t contextSize = 16;
+    static constexpr size_t tokenSize = 12;
+    static constexpr size_t maxTokens = 16;      // kept for each context in the table
+    static constexpr size_t maxCounted = 64;     // counted for each context in memory
+    static constexpr uint64_t maxBuilt = 200000; // newest indexed records in a new table
+    static constexpr uint64_t maxInline = 1 << 20;  // bytes of records caught up without a thread
+    static constexpr uint64_t minSaved = 256;    // records after the table before it is saved again
+
+protected:
+    struct Count {
+        uint64_t hash;
+        std::string token;
+        uint32_t count;
+    };
+    typedef std::unordered_map<uint64_t, std::vector<Count>> ContextCounts;
+    ContextCounts added;               // of the records after the table
+    ContextCounts recent;              // of the commands added since the catch up
+    typedef std::unordered_map<std::string, uint32_t> Counts;
+
+    Utilities::MappedFile map;
+    uint64_t noContexts;
+    uint64_t noTokens;
+    uint64_t fileId;
+    uint64_t endOffset;                // the records before are in the table
+    uint64_t countedEnd;               // and those before are in added
+    uint64_t noUnsaved;                // records in added
+    std::string fileName;
+
+    // building a table on a thread
+    std::unique_ptr<HistoryNextClass> table;
+    std::thread builder;
+    std::atomic<bool> building;
+    std::atomic<bool> stopBuild;
+    bool tableOk;
+
+    void ClearCounts();
+    bool CatchUp(const std::atomic<bool> *stop);
+    void StartBuild();
+    void Take(HistoryNextClass &from);
+    bool Read(const std::string &tableName);
+    bool Save(const std::string &tableName, const uint64_t end);
+    void CountCmd(const std::string_view &cmd, const std::string_view &folder, const uint32_t flags,
+                  ContextCounts &to);
+    static void AddCount(std::vector<Count> &counts, const std::string &token, const uint64_t hash, const uint32_t n);
+    void GetCounts(const uint64_t key, Counts &counts) const;
+
+    static uint64_t Key(const std::string_view &folder, const std::string_view &prev2, const std::string_view &prev1);
+    static bool IsSeparator(const std::string &tok);
+    static bool Tokens(const std::string &line, std::vector<std::string> &toks, std::vector<int> &starts);
+
+public:
+    HistoryNextClass();
+    ~HistoryNextClass();
+
+    void Clear();
+
+    // Catch up with the history file, reading the saved table the first time.
+    // Commands added since the last Update are dropped, the file has them. A
+    // long catch up is started on a thread and taken up by a later Update
+    bool Update(const std::string &histFile);
+    bool Building() const {return building;}
+    // a table built on the thread is waiting for Update
+    bool Ready() const {return table and !building;}
+
+    // count a command added to the history
+    void Add(const std::string_view &cmd, const std::string_view &folder, const uint32_t flags);
+
+    // The likeliest tokens to follow line, those in folder first, starting
+    // with the part of a token at its end. start is where they go in line
+    bool Predict(const std::string &line, const std::string &folder, const size_t max,
+                 std::vector<std::string> &res, size_t &start) const;
+
+    size_t NoContexts() const {return noContexts;}
+    size_t MemoryUsage() const;
+};
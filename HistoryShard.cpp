@@ -0,0 +1,229 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2024, John Burnell
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  HistoryShard.cpp
+  The indexed history records grouped by folder, saved beside the file
+-----------------------------------------------------------------------------*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include "HistoryShard.h"
+
+
+const char HistoryShardClass::magic[8] = {'C', 'R', 'A', 'B', 'S', 'H', 'R', 'D'};
+
+
+template <typename T>
+static T ReadValue(const char *p)
+{
+    T val;
+    std::memcpy(&val, p, sizeof(T));
+    return val;
+}
+
+
+template <typename T>
+static void WriteValue(std::string &buf, const T val)
+{
+    buf.append(reinterpret_cast<const char*>(&val), sizeof(T));
+}
+
+
+HistoryShardClass::HistoryShardClass()
+{
+    building = false;
+    stopBuild = false;
+    builtId = 0;
+    Unmap();
+}
+
+
+HistoryShardClass::~HistoryShardClass()
+{
+    Clear();
+}
+
+
+void HistoryShardClass::Clear()
+{
+    // a build in progress is dropped
+    stopBuild = true;
+    if (builder.joinable()) {
+        builder.join();
+    }
+    building = false;
+    builtId = 0;
+    Unmap();
+}
+
+
+void HistoryShardClass::Unmap()
+{
+    map.Close();
+    fileId = 0;
+    noIndexed = 0;
+    noShards = 0;
+}
+
+
+uint32_t HistoryShardClass::FolderHash(const std::string_view &folder)
+{
+    // FNV-1a
+    uint32_t h = 2166136261U;
+    for (char c : folder) {
+        h = (h ^ uint8_t(c)) * 16777619U;
+    }
+    return h;
+}
+
+
+bool HistoryShardClass::Update(const std::string &fileName, const HistoryFileClass &file, const size_t n)
+{
+    uint64_t id = Utilities::GetFileId(fileName);
+    if (n == 0 or id == 0 or !file.IsOpen()) {
+        Clear();
+        return false;
+    }
+    if (IsOpen() and id == fileId and file.NoIndexed() == noIndexed) {
+        return true;
+    }
+    if (building) {
+        return false;
+    }
+    if (builder.joinable()) {
+        builder.join();
+    }
+    std::string shardName = fileName + ".shd";
+    if (Read(shardName, id, file.NoIndexed())) {
+        return true;
+    }
+    if (builtId == id) {
+        // the build failed, or the file changed under it
+        return false;
+    }
+    builtId = id;
+    stopBuild = false;
+    building = true;
+    builder = std::thread([this, fileName, shardName, id, n]() {
+        Build(fileName, shardName, id, n, stopBuild);
+        building = false;
+    });
+    return false;
+}
+
+
+bool HistoryShardClass::Build(const std::string &fileName, const std::string &shardName, const uint64_t id,
+                              const size_t n, const std::atomic<bool> &stop)
+{
+    HistoryFileClass file;
+    if (!file.Open(fileName) or Utilities::GetFileId(fileName) != id) {
+        return false;
+    }
+
+    // the records are counted into their shards then placed in order
+    uint64_t count = file.NoIndexed();
+    std::vector<uint32_t> hashes(count);
+    std::vector<uint64_t> starts(n+1);
+    HistoryFileClass::Record rec;
+    for (uint64_t i = 0; i < count; i++) {
+        if (i % 4096 == 0 and stop) {
+            return false;
+        }
+        hashes[i] = file.DecodeIndexed(i, rec) ? FolderHash(rec.folder) : 0;
+        starts[hashes[i] % n + 1]++;
+    }
+    for (size_t s = 0; s < n; s++) {
+        starts[s+1] += starts[s];
+    }
+    std::string entries(count*entrySize, '\0');
+    std::vector<uint64_t> pos(starts.begin(), starts.end()-1);
+    for (uint64_t i = 0; i < count; i++) {
+        char *p = &entries[pos[hashes[i] % n]++ * entrySize];
+        uint32_t ind = i;
+        std::memcpy(p, &ind, 4);
+        std::memcpy(p+4, &hashes[i], 4);
+    }
+    std::string body;
+    body.reserve((n+1)*8 + entries.size());
+    for (uint64_t start : starts) {
+        WriteValue<uint64_t>(body, start);
+    }
+    body += entries;
+
+    std::string buf;
+    buf.append(magic, 8);
+    WriteValue<uint32_t>(buf, version);
+    WriteValue<uint32_t>(buf, Utilities::Crc32(body.data(), (n+1)*8));
+    WriteValue<uint64_t>(buf, id);
+    WriteValue<uint64_t>(buf, count);
+    WriteValue<uint64_t>(buf, n);
+    WriteValue<uint64_t>(buf, 0);
+
+    // another shell may be building them too, either copy will do. They
+    // can be built again, so are not synced
+    std::string tmpName = shardName + ".tmp" +
+                          std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+    return Utilities::WriteTempFile(tmpName, {buf, body}, false) and
+           Utilities::ReplaceFile(tmpName, shardName, false);
+}
+
+
+bool HistoryShardClass::Read(const std::string &shardName, const uint64_t id, const uint64_t count)
+{
+    Unmap();
+    if (!map.Open(shardName)) {
+        return false;
+    }
+    const char *data = map.Data();
+    size_t size = map.Size();
+    uint64_t n = size >= headerSize ? ReadValue<uint64_t>(data+32) : 0;
+    if (size < headerSize or std::memcmp(data, magic, 8) != 0 or ReadValue<uint32_t>(data+8) != version or
+        ReadValue<uint64_t>(data+16) != id or ReadValue<uint64_t>(data+24) != count or n == 0 or
+        n > size / 8 or size != headerSize + (n+1)*8 + count*entrySize) {
+        // out of date, the file has been rewritten
+        map.Close();
+        return false;
+    }
+    // an entry is checked against the record it refers to as it is used
+    if (ReadValue<uint32_t>(data+12) != Utilities::Crc32(data+headerSize, (n+1)*8)) {
+        Utilities::LogMessage("History shards " + shardName + " are damaged, rebuilding them");
+        map.Close();
+        return false;
+    }
+    fileId = id;
+    noIndexed = count;
+    noShards = n;
+    return true;
+}
+
+
+void HistoryShardClass::FolderRecords(const HistoryFileClass &file, const std::string_view &folder,
+                                      const size_t max, const uint64_t before, std::vector<uint64_t> &inds) const
+{
+    // collected newest first, the hash is checked before the record is read
+    inds.clear();
+    if (!IsOpen()) {
+        return;
+    }
+    uint32_t hash = FolderHash(folder);
+    const char *starts = map.Data() + headerSize;
+    const char *entries = starts + (noShards+1)*8;
+    uint64_t shard = hash % noShards;
+    uint64_t first = std::min(ReadValue<uint64_t>(starts + shard*8), noIndexed);
+    uint64_t last = std::min(ReadValue<uint64_t>(starts + (shard+1)*8), noIndexed);
+    HistoryFileClass::Record rec;
+    for (uint64_t e = last; e > first and inds.size() < max; e--) {
+        const char *p = entries + (e-1)*entrySize;
+        uint32_t ind = ReadValue<uint32_t>(p);
+        if (ind < before and ReadValue<uint32_t>(p+4) == hash and file.DecodeIndexed(ind, rec) and
+            rec.folder == folder) {
+            inds.push_back(ind);
+        }
+    }
+    std::reverse(inds.begin(), inds.end());
+}
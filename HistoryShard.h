@@ -0,0 +1,80 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2024, John Burnell
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  HistoryShard.h
+  The indexed history records grouped by folder, saved beside the file
+-----------------------------------------------------------------------------*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "HistoryFile.h"
+
+
+class HistoryShardClass {
+    // The history file is the log of all commands in time order. The records
+    // in its index are also split into shards by a hash of their folder, so
+    // the older records of a folder are found by reading its shard rather
+    // than the whole file. The index only changes when the file is rewritten,
+    // so the shards are built then (or on the first load after) and saved
+    // beside the file (as .shd), where they are mapped and read in place.
+    // They are built on a thread from its own mapping of the file, until they
+    // are ready the folders' records are found from the cold segments.
+    //
+    // Shards:  "CRABSHRD" u32 version, u32 crc32(starts), u64 fileId, u64 noIndexed,
+    //          u64 noShards, u64 unused
+    //          starts[noShards+1] u64 first entry of each shard
+    //          entries[noIndexed] u32 index record, u32 folder hash, in record
+    //                             order within a shard
+public:
+    static const char magic[8];
+    static constexpr uint32_t version = 1;
+    static constexpr size_t headerSize = 48;
+    static constexpr size_t entrySize = 8;
+
+protected:
+    Utilities::MappedFile map;
+    uint64_t fileId;
+    uint64_t noIndexed;
+    uint64_t noShards;
+
+    // building them on a thread
+    std::thread builder;
+    std::atomic<bool> building;
+    std::atomic<bool> stopBuild;
+    uint64_t builtId;                // of the file last built for, not built again
+
+    void Unmap();
+    bool Read(const std::string &shardName, const uint64_t id, const uint64_t count);
+    static bool Build(const std::string &fileName, const std::string &shardName, const uint64_t id, const size_t n,
+                      const std::atomic<bool> &stop);
+
+public:
+    HistoryShardClass();
+    ~HistoryShardClass();
+
+    void Clear();
+
+    // Map the shards of file, named fileName, starting to build them with n
+    // shards if they are missing or out of date. False until they are built.
+    // n of 0 turns them off
+    bool Update(const std::string &fileName, const HistoryFileClass &file, const size_t n);
+    bool Building() const {return building;}
+    bool IsOpen() const {return noShards > 0;}
+
+    static uint32_t FolderHash(const std::string_view &folder);
+
+    // Up to max of the newest index records of folder before index record
+    // before, oldest first
+    void FolderRecords(const HistoryFileClass &file, const std::string_view &folder, const size_t max,
+                       const uint64_t before, std::vector<uint64_t> &inds) const;
+};
@@ -0,0 +1,130 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2024, John Burnell
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  HistoryStore.cpp
+  Column store for the history entries
+-----------------------------------------------------------------------------*/
+
+#include <algorithm>
+
+#include "HistoryStore.h"
+
+
+static const uint64_t arenaBit = uint64_t(1) << 63;
+
+
+HistoryStoreClass::HistoryStoreClass()
+{
+    mapData = nullptr;
+    mapSize = 0;
+    Clear();
+}
+
+
+void HistoryStoreClass::Clear()
+{
+    mapData = nullptr;
+    mapSize = 0;
+    blocks.Clear();
+    blockUsed = 0;
+    blockCap = 0;
+    cmdOffsets.Clear();
+    cmdLens.Clear();
+    times.Clear();
+    folderIds.Clear();
+    folderNames.clear();
+    folderLookup.clear();
+    InternFolder("");
+}
+
+
+void HistoryStoreClass::SetMapping(const char *data, const size_t size)
+{
+    mapData = data;
+    mapSize = size;
+}
+
+
+uint32_t HistoryStoreClass::InternFolder(const std::string_view &folder)
+{
+    auto it = folderLookup.find(folder);
+    if (it != folderLookup.end()) {
+        return it->second;
+    }
+    uint32_t id = folderNames.size();
+    folderNames.emplace_back(folder);
+    folderLookup[folderNames.back()] = id;
+    return id;
+}
+
+
+uint32_t HistoryStoreClass::FindFolder(const std::string_view &folder) const
+{
+    auto it = folderLookup.find(folder);
+    if (it != folderLookup.end()) {
+        return it->second;
+    }
+    return noFolder;
+}
+
+
+uint64_t HistoryStoreClass::StoreText(const std::string_view &st)
+{
+    // a block is never reallocated, so its text does not move
+    if (blocks.Empty() or blockUsed + st.size() > blockCap) {
+        blockCap = std::max(blockSize, st.size());
+        blocks.Add(new char[blockCap]);
+        blockUsed = 0;
+    }
+    uint64_t offset = arenaBit | (uint64_t(blocks.Size()-1) << 32) | blockUsed;
+    std::copy(st.begin(), st.end(), blocks.Back().get() + blockUsed);
+    blockUsed += st.size();
+    return offset;
+}
+
+
+uint32_t HistoryStoreClass::Add(const std::string_view &cmd, const int64_t time, const uint32_t folderId)
+{
+    uint64_t offset;
+    if (mapData != nullptr and cmd.data() >= mapData and cmd.data() + cmd.size() <= mapData + mapSize) {
+        offset = cmd.data() - mapData;
+    } else {
+        offset = StoreText(cmd);
+    }
+
+    uint32_t ind = times.Size();
+    cmdOffsets.Add(offset);
+    cmdLens.Add(cmd.size());
+    folderIds.Add(folderId);
+    times.Add(time);
+    return ind;
+}
+
+
+std::string_view HistoryStoreClass::Cmd(const uint32_t ind) const
+{
+    uint64_t offset = cmdOffsets[ind];
+    if (offset & arenaBit) {
+        const char *block = blocks[(offset & ~arenaBit) >> 32].get();
+        return std::string_view(block + (offset & 0xFFFFFFFF), cmdLens[ind]);
+    }
+    return std::string_view(mapData + offset, cmdLens[ind]);
+}
+
+
+size_t HistoryStoreClass::MemoryUsage() const
+{
+    size_t mem = cmdOffsets.MemoryUsage() + cmdLens.MemoryUsage() + times.MemoryUsage() + 
+                 folderIds.MemoryUsage() + blocks.MemoryUsage();
+    for (size_t b = 0; b+1 < blocks.Size(); b++) {
+        mem += blockSize;
+    }
+    mem += blockCap;
+    for (const auto &name : folderNames) {
+        mem += sizeof(std::string) + name.capacity() + 2*sizeof(void*) + sizeof(uint32_t);
+    }
+    return mem;
+}
@@ -0,0 +1,90 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2024, John Burnell
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  HistoryStore.h
+  Column store for the history entries
+-----------------------------------------------------------------------------*/
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "HistoryArray.h"
+
+
+// An entry in the history, the strings point into the store
+struct HistoryEntry {
+    std::string_view cmd;
+    std::string_view folder;
+    int64_t time;
+};
+
+
+class HistoryStoreClass {
+    // The history is kept as columns: command offsets and lengths, times and
+    // folder ids. Command text is either in the mapped history file or in an
+    // arena of fixed blocks owned by the store, an offset with the top bit set
+    // is (block << 32 | position) in the arena. Neither moves, so the text can
+    // be referred to by string_views for the life of the store.
+    // Folder names are interned, folder 0 is the empty folder.
+    // One thread adds entries. The command, time and folder id of an entry
+    // can be read by other threads without locking once the index of the
+    // entry has been passed to them, folder names only by the one adding.
+public:
+    static constexpr uint32_t noFolder = 0xFFFFFFFF;
+    static constexpr size_t blockSize = 64*1024;
+
+protected:
+    const char *mapData;                 // the mapped history file, not owned
+    size_t mapSize;
+    HistoryArrayClass<std::unique_ptr<char[]>> blocks;     // arena for commands added since loading
+    size_t blockUsed;                    // of the last block
+    size_t blockCap;
+
+    HistoryArrayClass<uint64_t> cmdOffsets;
+    HistoryArrayClass<uint32_t> cmdLens;
+    HistoryArrayClass<int64_t> times;
+    HistoryArrayClass<uint32_t> folderIds;
+
+    std::deque<std::string> folderNames;
+    std::unordered_map<std::string_view, uint32_t> folderLookup;
+
+    uint64_t StoreText(const std::string_view &st);
+
+public:
+    HistoryStoreClass();
+
+    // only when nothing is reading
+    void Clear();
+
+    // the mapped file that loaded commands point into
+    void SetMapping(const char *data, const size_t size);
+
+    uint32_t InternFolder(const std::string_view &folder);
+    uint32_t FindFolder(const std::string_view &folder) const;
+    std::string_view FolderName(const uint32_t id) const {return folderNames[id];}
+    size_t NoFolders() const {return folderNames.size();}
+
+    // Add an entry, text outside the mapping is copied to the arena
+    uint32_t Add(const std::string_view &cmd, const int64_t time, const uint32_t folderId);
+
+    size_t Size() const {return times.Size();}
+
+    std::string_view Cmd(const uint32_t ind) const;
+    int64_t Time(const uint32_t ind) const {return times[ind];}
+    uint32_t FolderId(const uint32_t ind) const {return folderIds[ind];}
+    std::string_view Folder(const uint32_t ind) const {return folderNames[folderIds[ind]];}
+    HistoryEntry Get(const uint32_t ind) const {return {Cmd(ind), Folder(ind), times[ind]};}
+
+    // approximate heap use in bytes
+    size_t MemoryUsage() const;
+};
@@ -0,0 +1,216 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2024, John Burnell
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  HistoryText.cpp
+  Parser for the original yaml text history
+-----------------------------------------------------------------------------*/
+
+#include <cstring>
+#include <ctime>
+
+#include "HistoryText.h"
+#include "Utilities.h"
+
+#if defined(AVX2_DISPATCH) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+
+HistoryTextParserClass::HistoryTextParserClass()
+{
+    lastHour[0] = -1;
+    lastHourTime = 0;
+}
+
+
+#ifdef AVX2_DISPATCH
+// the newline in [p, end) 32 bytes at a time, or where fewer than 32 are left
+AVX2_TARGET static const char *FindNewlineAVX2(const char *p, const char *end)
+{
+    const __m256i nl32 = _mm256_set1_epi8('\n');
+    for (; end - p >= 32; p += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        uint32_t mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, nl32));
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return p;
+}
+#endif
+
+
+const char *HistoryTextParserClass::FindNewline(const char *p, const char *end)
+{
+#ifdef AVX2_DISPATCH
+    if (Utilities::HasAVX2()) {
+        p = FindNewlineAVX2(p, end);
+        if (p < end and *p == '\n') {
+            return p;
+        }
+    }
+#endif
+#if defined(__SSE2__)
+    const __m128i nl16 = _mm_set1_epi8('\n');
+    for (; end - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        uint32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, nl16));
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+#endif
+    for (; p < end; p++) {
+        if (*p == '\n') {
+            return p;
+        }
+    }
+    return end;
+}
+
+
+static std::string_view StripEnd(const char *start, const char *end)
+{
+    const char *p = end;
+    while (p > start and (p[-1] == ' ' or p[-1] == '\t' or p[-1] == '\r')) {
+        p--;
+    }
+    return std::string_view(start, p - start);
+}
+
+
+std::string_view HistoryTextParserClass::Field(const std::string_view &line, const std::string_view &key, bool &found)
+{
+    // the key is normally after the indent, otherwise search the line
+    size_t pos = line.find_first_not_of(' ');
+    if (pos == line.npos or line.compare(pos, key.size(), key) != 0) {
+        pos = line.find(key);
+    }
+    found = pos != line.npos;
+    if (!found) {
+        // an empty value loses the space after the key when the line is stripped
+        std::string_view bare = key.substr(0, key.size()-1);
+        found = line.size() >= bare.size() and line.compare(line.size()-bare.size(), bare.size(), bare) == 0;
+        return std::string_view();
+    }
+    std::string_view st = line.substr(pos + key.size());
+
+    // remove the quotes the yaml writer put around the date
+    if (st.size() > 0 and st[0] == '\'') {
+        st.remove_prefix(1);
+        size_t pos1 = st.find('\'');
+        if (pos1 == st.size()-1) {
+            st.remove_suffix(1);
+        } else if (pos1 != st.npos) {
+            quoted.emplace_back(st);
+            quoted.back().erase(pos1, 1);
+            st = quoted.back();
+        }
+    }
+    return st;
+}
+
+
+static bool ParseNumber(const std::string_view &st, const size_t pos, const size_t len, int &val)
+{
+    val = 0;
+    for (size_t i = pos; i < pos+len; i++) {
+        if (st[i] < '0' or st[i] > '9') {
+            return false;
+        }
+        val = val*10 + (st[i] - '0');
+    }
+    return true;
+}
+
+
+int64_t HistoryTextParserClass::ParseTime(const std::string_view &st)
+{
+    // "%Y-%m-%d %H:%M:%S", mktime is only needed when the hour changes
+    int hour[4], min, sec;
+    if (st.size() != 19 or st[4] != '-' or st[7] != '-' or st[10] != ' ' or st[13] != ':' or st[16] != ':' or
+        !ParseNumber(st, 0, 4, hour[0]) or !ParseNumber(st, 5, 2, hour[1]) or !ParseNumber(st, 8, 2, hour[2]) or
+        !ParseNumber(st, 11, 2, hour[3]) or !ParseNumber(st, 14, 2, min) or !ParseNumber(st, 17, 2, sec)) {
+        return Utilities::ParseTime(std::string(st));
+    }
+    if (std::memcmp(hour, lastHour, sizeof(hour)) != 0) {
+        std::tm tm = {};
+        tm.tm_year = hour[0] - 1900;
+        tm.tm_mon = hour[1] - 1;
+        tm.tm_mday = hour[2];
+        tm.tm_hour = hour[3];
+        tm.tm_isdst = -1;
+        lastHourTime = std::mktime(&tm);
+        std::memcpy(lastHour, hour, sizeof(hour));
+    }
+    return lastHourTime + min*60 + sec;
+}
+
+
+bool HistoryTextParserClass::Parse(const char *data, const size_t size, std::vector<HistoryFileClass::Record> &recs)
+{
+    const char *end = data + size;
+    const char *p = data;
+    auto nextLine = [&p, end](std::string_view &line) {
+        if (p >= end) {
+            return false;
+        }
+        const char *nl = FindNewline(p, end);
+        line = StripEnd(p, nl);
+        p = nl + 1;
+        return true;
+    };
+
+    // search start - "History:"
+    std::string_view line;
+    bool found = false;
+    while (nextLine(line)) {
+        if (line == "History:") {
+            found = true;
+            break;
+        }
+    }
+    if (!found) {
+        return false;
+    }
+
+    // roughly 80 bytes per entry
+    recs.reserve(recs.size() + (end - p) / 80);
+
+    // a missing Date or Folder keeps the value of the previous entry
+    const std::string_view keys[] = {"- Cmd: ", "Date: ", "Folder: "};
+    std::string_view fields[3];
+    std::string_view date;
+    int64_t time = 0;
+    while (nextLine(line)) {
+        bool have;
+        std::string_view cmd = Field(line, keys[0], have);
+        if (!have) {
+            continue;
+        }
+        fields[0] = cmd;
+        bool complete = true;
+        for (int i = 1; i < 3; i++) {
+            if (!nextLine(line)) {
+                complete = false;
+                break;
+            }
+            std::string_view st = Field(line, keys[i], have);
+            if (have) {
+                fields[i] = st;
+            }
+        }
+        if (!complete) {
+            break;
+        }
+        if (fields[1] != date) {
+            date = fields[1];
+            time = ParseTime(date);
+        }
+        recs.push_back({time, 0, fields[0], fields[2]});
+    }
+    return true;
+}
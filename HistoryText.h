@@ -0,0 +1,50 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2024, John Burnell
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  HistoryText.h
+  Parser for the original yaml text history
+-----------------------------------------------------------------------------*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "HistoryFile.h"
+
+
+class HistoryTextParserClass {
+    // Single pass over the whole text, lines are found with a vector scan for
+    // newlines (AVX2 if the CPU has it, SSE2 when the compiler targets it,
+    // else scalar) and each entry is three lines:
+    //   - Cmd: ls
+    //     Date: '2024-01-31 10:20:30'
+    //     Folder: /home/user
+    // Records point into the text, only fields with an embedded quote are
+    // copied, into quoted.
+protected:
+    std::deque<std::string> quoted;
+
+    // the hour of the last date parsed, dates mostly follow each other
+    int lastHour[4];
+    int64_t lastHourTime;
+
+    std::string_view Field(const std::string_view &line, const std::string_view &key, bool &found);
+    int64_t ParseTime(const std::string_view &st);
+
+public:
+    HistoryTextParserClass();
+
+    // parse text into recs, false if there is no "History:" line
+    bool Parse(const char *data, const size_t size, std::vector<HistoryFileClass::Record> &recs);
+
+    // the first '\n' in [p, end) or end
+    static const char *FindNewline(const char *p, const char *end);
+};
@@ -0,0 +1,121 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2024, John Burnell
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  HistoryTrie.cpp
+  Radix trie over history commands for prefix lookups
+-----------------------------------------------------------------------------*/
+
+#include <algorithm>
+
+#include "HistoryTrie.h"
+
+
+HistoryTrieClass::HistoryTrieClass()
+{
+    Clear();
+}
+
+
+void HistoryTrieClass::Clear()
+{
+    nodes.Clear();
+    nodes.Add(std::string_view(), Best(noEntry, 0.0f), noEntry, noEntry);
+}
+
+
+uint32_t HistoryTrieClass::NewNode(const std::string_view &label, const uint64_t best, const uint32_t child,
+                                   const uint32_t next)
+{
+    nodes.Add(label, best, child, next);
+    return nodes.Size() - 1;
+}
+
+
+uint32_t HistoryTrieClass::FindChild(const uint32_t node, const char c) const
+{
+    uint32_t ch = nodes[node].child.load(std::memory_order_acquire);
+    while (ch != noEntry and nodes[ch].first != c) {
+        ch = nodes[ch].next.load(std::memory_order_acquire);
+    }
+    return ch;
+}
+
+
+void HistoryTrieClass::Insert(const std::string_view &cmd, const uint32_t entry, const float rank)
+{
+    // a new node is complete before it is linked in
+    const uint64_t best = Best(entry, rank);
+    uint32_t node = 0;
+    size_t pos = 0;
+    while (true) {
+        Node &nd = nodes[node];
+        uint64_t cur = nd.best.load(std::memory_order_relaxed);
+        if (Entry(cur) == noEntry or rank > Rank(cur) or (rank == Rank(cur) and entry > Entry(cur))) {
+            nd.best.store(best, std::memory_order_release);
+        }
+        if (pos == cmd.size()) {
+            return;
+        }
+
+        uint32_t ch = FindChild(node, cmd[pos]);
+        if (ch == noEntry) {
+            uint32_t leaf = NewNode(cmd.substr(pos), best, noEntry, nd.child.load(std::memory_order_relaxed));
+            nd.child.store(leaf, std::memory_order_release);
+            return;
+        }
+
+        // length of the common part of the edge
+        std::string_view label = nodes[ch].Label();
+        size_t n = 0;
+        size_t maxN = std::min(label.size(), cmd.size()-pos);
+        while (n < maxN and label[n] == cmd[pos+n]) {
+            n++;
+        }
+
+        if (n < label.size()) {
+            // split the edge, two new nodes take the place of ch, which is
+            // left as it was for anyone part way through it
+            Node &old = nodes[ch];
+            uint64_t oldBest = old.best.load(std::memory_order_relaxed);
+            uint32_t rest = NewNode(label.substr(n), oldBest, old.child.load(std::memory_order_relaxed), noEntry);
+            uint32_t mid = NewNode(label.substr(0, n), oldBest, rest, old.next.load(std::memory_order_relaxed));
+            // relink from the parent
+            if (nd.child.load(std::memory_order_relaxed) == ch) {
+                nd.child.store(mid, std::memory_order_release);
+            } else {
+                uint32_t prev = nd.child.load(std::memory_order_relaxed);
+                while (nodes[prev].next.load(std::memory_order_relaxed) != ch) {
+                    prev = nodes[prev].next.load(std::memory_order_relaxed);
+                }
+                nodes[prev].next.store(mid, std::memory_order_release);
+            }
+            ch = mid;
+        }
+        node = ch;
+        pos += n;
+    }
+}
+
+
+uint32_t HistoryTrieClass::Find(const std::string_view &pref) const
+{
+    uint32_t node = 0;
+    size_t pos = 0;
+    while (pos < pref.size()) {
+        uint32_t ch = FindChild(node, pref[pos]);
+        if (ch == noEntry) {
+            return noEntry;
+        }
+        std::string_view label = nodes[ch].Label();
+        size_t n = std::min(label.size(), pref.size()-pos);
+        if (label.compare(0, n, pref.substr(pos, n)) != 0) {
+            return noEntry;
+        }
+        node = ch;
+        pos += n;
+    }
+    return Entry(nodes[node].best.load(std::memory_order_acquire));
+}
@@ -0,0 +1,78 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2024, John Burnell
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  HistoryTrie.h
+  Radix trie over history commands for prefix lookups
+-----------------------------------------------------------------------------*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#include "HistoryArray.h"
+
+
+class HistoryTrieClass {
+    // Each node stores the best entry in its subtree, the one with the highest
+    // rank and then the newest. Entries are added in increasing order and a
+    // command's rank only grows when it is added again, so an insert just
+    // marks every node on its path and a lookup of the best match is a walk of
+    // the prefix. With no ranks the best entry is the most recent.
+    // One thread inserts while others look up without locking. A node's label
+    // never changes, an edge is split by linking new nodes in place of the
+    // old one, and the links and best entries are atomic. Nodes are only
+    // freed by Clear.
+    // Edge labels point into the command text, which must outlive the trie.
+public:
+    static constexpr uint32_t noEntry = 0xFFFFFFFF;
+
+protected:
+    struct Node {
+        const char *text;                    // edge from the parent
+        uint32_t len;
+        char first;                          // text[0], so siblings are told apart without reading the text
+        std::atomic<uint64_t> best;          // rank bits << 32 | best entry in this subtree
+        std::atomic<uint32_t> child;         // first child
+        std::atomic<uint32_t> next;          // next sibling
+
+        Node(const std::string_view &l, const uint64_t b, const uint32_t c, const uint32_t n) :
+            text(l.data()), len(l.size()), first(l.empty() ? 0 : l[0]), best(b), child(c), next(n) {}
+        std::string_view Label() const {return std::string_view(text, len);}
+    };
+    HistoryArrayClass<Node> nodes;           // nodes[0] is the root
+
+    static uint64_t Best(const uint32_t entry, const float rank) {
+        uint32_t bits;
+        std::memcpy(&bits, &rank, sizeof(bits));
+        return (uint64_t(bits) << 32) | entry;
+    }
+    static uint32_t Entry(const uint64_t best) {return uint32_t(best);}
+    static float Rank(const uint64_t best) {
+        uint32_t bits = best >> 32;
+        float rank;
+        std::memcpy(&rank, &bits, sizeof(rank));
+        return rank;
+    }
+
+    uint32_t FindChild(const uint32_t node, const char c) const;
+    uint32_t NewNode(const std::string_view &label, const uint64_t best, const uint32_t child, const uint32_t next);
+
+public:
+    HistoryTrieClass();
+
+    // only when nothing is reading
+    void Clear();
+    void Insert(const std::string_view &cmd, const uint32_t entry, const float rank=0.0f);
+
+    // the best entry starting with pref, or noEntry
+    uint32_t Find(const std::string_view &pref) const;
+
+    size_t NoNodes() const {return nodes.Size();}
+    size_t MemoryUsage() const {return nodes.MemoryUsage();}
+};
@@ -0,0 +1,404 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2024, John Burnell
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  HistoryTrigram.cpp
+  Trigram index of the history file for substring searches
+-----------------------------------------------------------------------------*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iterator>
+#include <unordered_set>
+
+#include <filesystem>
+namespace fs = std::filesystem;
+
+#include "HistoryTrigram.h"
+
+
+const char HistoryTrigramClass::magic[8] = {'C', 'R', 'A', 'B', 'T', 'R', 'I', 'G'};
+
+
+template <typename T>
+static T ReadValue(const char *p)
+{
+    T val;
+    std::memcpy(&val, p, sizeof(T));
+    return val;
+}
+
+
+template <typename T>
+static void WriteValue(std::string &buf, const T val)
+{
+    buf.append(reinterpret_cast<const char*>(&val), sizeof(T));
+}
+
+
+static inline char Fold(const char c)
+{
+    return (c >= 'A' and c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+
+static std::string FoldString(const std::string_view &st)
+{
+    std::string folded(st);
+    std::transform(folded.begin(), folded.end(), folded.begin(), Fold);
+    return folded;
+}
+
+
+HistoryTrigramClass::HistoryTrigramClass()
+{
+    building = false;
+    stopBuild = false;
+    tableOk = false;
+    Clear();
+}
+
+
+HistoryTrigramClass::~HistoryTrigramClass()
+{
+    Clear();
+}
+
+
+void HistoryTrigramClass::Clear()
+{
+    // an index being built is dropped
+    stopBuild = true;
+    if (builder.joinable()) {
+        builder.join();
+    }
+    table.reset();
+    building = false;
+    fileName.clear();
+    file.Close();
+    ClearIndex();
+}
+
+
+void HistoryTrigramClass::ClearIndex()
+{
+    postings.clear();
+    offsets.clear();
+    fileId = 0;
+    endOffset = 0;
+    noSaved = 0;
+}
+
+
+void HistoryTrigramClass::Trigrams(const std::string &st, std::vector<uint32_t> &keys)
+{
+    keys.clear();
+    for (size_t i = 0; i + 3 <= st.size(); i++) {
+        keys.push_back(uint32_t(uint8_t(st[i])) << 16 | uint32_t(uint8_t(st[i+1])) << 8 | uint8_t(st[i+2]));
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+}
+
+
+void HistoryTrigramClass::AddRecord(const std::string_view &cmd, const uint64_t offset)
+{
+    uint32_t rec = offsets.size();
+    offsets.push_back(offset);
+
+    std::vector<uint32_t> keys;
+    Trigrams(FoldString(cmd), keys);
+    for (uint32_t key : keys) {
+        Posting &post = postings[key];
+        uint32_t delta = post.data.empty() ? rec : rec - post.last;
+        while (delta >= 0x80) {
+            post.data.push_back(char(delta | 0x80));
+            delta >>= 7;
+        }
+        post.data.push_back(char(delta));
+        post.last = rec;
+    }
+}
+
+
+void HistoryTrigramClass::Decode(const Posting &post, std::vector<uint32_t> &recs)
+{
+    recs.clear();
+    uint32_t rec = 0;
+    const char *p = post.data.data();
+    const char *end = p + post.data.size();
+    while (p < end) {
+        uint32_t delta = 0;
+        int shift = 0;
+        while (p < end and (uint8_t(*p) & 0x80)) {
+            delta |= uint32_t(uint8_t(*p++) & 0x7F) << shift;
+            shift += 7;
+        }
+        if (p < end) {
+            delta |= uint32_t(uint8_t(*p++)) << shift;
+        }
+        rec += delta;
+        recs.push_back(rec);
+    }
+}
+
+
+bool HistoryTrigramClass::Update(const std::string &histFile)
+{
+    if (histFile != fileName) {
+        Clear();
+        fileName = histFile;
+        StartBuild();
+        return false;
+    }
+    if (building) {
+        return false;
+    }
+    if (table) {
+        builder.join();
+        if (tableOk) {
+            Take(*table);
+        }
+        table.reset();
+    }
+
+    // a replaced file, or many records to catch up with, is left to a thread
+    std::error_code ec;
+    uint64_t size = fs::file_size(fileName, ec);
+    uint64_t id = Utilities::GetFileId(fileName);
+    if (ec or id == 0) {
+        return false;
+    }
+    if (id != fileId or endOffset == 0 or endOffset > size or size - endOffset > maxInline) {
+        StartBuild();
+        return false;
+    }
+    return CatchUp(nullptr);
+}
+
+
+void HistoryTrigramClass::StartBuild()
+{
+    // the thread starts from the saved index, which may be another shell's
+    table = std::make_unique<HistoryTrigramClass>();
+    table->fileName = fileName;
+    tableOk = false;
+    stopBuild = false;
+    building = true;
+    builder = std::thread([this]() {
+        table->Read(table->fileName + ".tri");
+        tableOk = table->CatchUp(&stopBuild);
+        building = false;
+    });
+}
+
+
+void HistoryTrigramClass::Take(HistoryTrigramClass &from)
+{
+    // the file is mapped again by the next catch up
+    postings.swap(from.postings);
+    offsets.swap(from.offsets);
+    fileId = from.fileId;
+    endOffset = from.endOffset;
+    noSaved = from.noSaved;
+    file.Close();
+}
+
+
+bool HistoryTrigramClass::CatchUp(const std::atomic<bool> *stop)
+{
+    std::error_code ec;
+    uint64_t size = fs::file_size(fileName, ec);
+    uint64_t id = Utilities::GetFileId(fileName);
+    if (ec or id == 0) {
+        return false;
+    }
+    if (id != fileId or endOffset > size) {
+        // replaced, usually compacted, so start again
+        ClearIndex();
+        file.Close();
+        fileId = id;
+    }
+    if (file.IsOpen() and file.Size() == size) {
+        return true;
+    }
+    if (!file.Open(fileName)) {
+        return false;
+    }
+
+    if (endOffset == 0) {
+        HistoryFileClass::Record rec;
+        for (uint64_t i = 0; i < file.NoIndexed(); i++) {
+            if (stop != nullptr and i % 1024 == 0 and *stop) {
+                return false;
+            }
+            uint64_t offset = file.IndexedOffset(i);
+            if (file.DecodeRecord(offset, rec, false) > 0) {
+                AddRecord(rec.cmd, offset);
+            }
+        }
+        endOffset = file.TailStart();
+    }
+    std::vector<HistoryFileClass::Record> recs;
+    std::vector<uint64_t> recOffsets;
+    endOffset = HistoryFileClass::Scan(file.Data(), file.Size(), std::max(endOffset, file.TailStart()),
+                                       recs, &recOffsets);
+    for (size_t i = 0; i < recs.size(); i++) {
+        if (stop != nullptr and i % 1024 == 0 and *stop) {
+            return false;
+        }
+        AddRecord(recs[i].cmd, recOffsets[i]);
+    }
+
+    // the whole index is written, so only on the thread and once there is a
+    // bit more
+    if (stop != nullptr and (noSaved == 0 or offsets.size() >= noSaved + 256)) {
+        Save(fileName + ".tri");
+    }
+    return true;
+}
+
+
+bool HistoryTrigramClass::Search(const std::string_view &query, const size_t max, std::vector<std::string> &res) const
+{
+    res.clear();
+    std::string q = FoldString(query);
+    if (q.size() < 3) {
+        return false;
+    }
+    if (!file.IsOpen()) {
+        return true;
+    }
+
+    // intersect the lists, shortest first
+    std::vector<uint32_t> keys;
+    Trigrams(q, keys);
+    std::vector<const Posting*> lists;
+    for (uint32_t key : keys) {
+        auto it = postings.find(key);
+        if (it == postings.end()) {
+            return true;
+        }
+        lists.push_back(&it->second);
+    }
+    std::sort(lists.begin(), lists.end(), [](const Posting *a, const Posting *b) {
+        return a->data.size() < b->data.size();
+    });
+    std::vector<uint32_t> cands, recs, both;
+    Decode(*lists[0], cands);
+    for (size_t i = 1; i < lists.size() and !cands.empty(); i++) {
+        Decode(*lists[i], recs);
+        both.clear();
+        std::set_intersection(cands.begin(), cands.end(), recs.begin(), recs.end(), std::back_inserter(both));
+        cands.swap(both);
+    }
+
+    // the trigrams can be in a different order, so check the newest first
+    std::unordered_set<std::string_view> seen;
+    HistoryFileClass::Record rec;
+    for (auto it = cands.rbegin(); it != cands.rend() and res.size() < max; it++) {
+        if (file.DecodeRecord(offsets[*it], rec, false) == 0) {
+            continue;
+        }
+        if (FoldString(rec.cmd).find(q) != std::string::npos and seen.insert(rec.cmd).second) {
+            res.emplace_back(rec.cmd);
+        }
+    }
+    return true;
+}
+
+
+bool HistoryTrigramClass::Save(const std::string &indexName)
+{
+    // header, record offsets then (key, last, length, data) for each list
+    std::string body;
+    body.reserve(offsets.size()*8 + postings.size()*16);
+    body.append(reinterpret_cast<const char*>(offsets.data()), offsets.size()*8);
+    for (const auto &it : postings) {
+        WriteValue<uint32_t>(body, it.first);
+        WriteValue<uint32_t>(body, it.second.last);
+        WriteValue<uint32_t>(body, it.second.data.size());
+        body.append(it.second.data);
+    }
+
+    std::string buf;
+    buf.append(magic, 8);
+    WriteValue<uint32_t>(buf, version);
+    WriteValue<uint32_t>(buf, Utilities::Crc32(body.data(), body.size()));
+    WriteValue<uint64_t>(buf, fileId);
+    WriteValue<uint64_t>(buf, endOffset);
+    WriteValue<uint64_t>(buf, offsets.size());
+    WriteValue<uint64_t>(buf, postings.size());
+
+    // another shell may be saving too, either copy will do
+    std::string tmpName = indexName + ".tmp" + 
+                          std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+    if (!Utilities::WriteTempFile(tmpName, {buf, body}, false) or
+        !Utilities::ReplaceFile(tmpName, indexName, false)) {
+        return false;
+    }
+    noSaved = offsets.size();
+    return true;
+}
+
+
+bool HistoryTrigramClass::Read(const std::string &indexName)
+{
+    Utilities::MappedFile map;
+    if (!map.Open(indexName)) {
+        return false;
+    }
+    const char *data = map.Data();
+    size_t size = map.Size();
+    if (size < headerSize or std::memcmp(data, magic, 8) != 0 or ReadValue<uint32_t>(data+8) != version or
+        ReadValue<uint32_t>(data+12) != Utilities::Crc32(data+headerSize, size-headerSize)) {
+        Utilities::LogMessage("History search index " + indexName + " is damaged, rebuilding it");
+        return false;
+    }
+
+    ClearIndex();
+    uint64_t noRecs = ReadValue<uint64_t>(data+32);
+    uint64_t noKeys = ReadValue<uint64_t>(data+40);
+    const char *p = data + headerSize;
+    const char *end = data + size;
+    if (uint64_t(end - p) < noRecs*8) {
+        return false;
+    }
+    offsets.resize(noRecs);
+    std::memcpy(offsets.data(), p, noRecs*8);
+    p += noRecs*8;
+    postings.reserve(noKeys);
+    for (uint64_t i = 0; i < noKeys; i++) {
+        if (end - p < 12) {
+            ClearIndex();
+            return false;
+        }
+        uint32_t key = ReadValue<uint32_t>(p);
+        uint32_t len = ReadValue<uint32_t>(p+8);
+        if (uint64_t(end - p - 12) < len) {
+            ClearIndex();
+            return false;
+        }
+        Posting &post = postings[key];
+        post.last = ReadValue<uint32_t>(p+4);
+        post.data.assign(p+12, len);
+        p += 12 + len;
+    }
+    fileId = ReadValue<uint64_t>(data+16);
+    endOffset = ReadValue<uint64_t>(data+24);
+    noSaved = noRecs;
+    return true;
+}
+
+
+size_t HistoryTrigramClass::MemoryUsage() const
+{
+    size_t mem = offsets.capacity()*sizeof(uint64_t);
+    for (const auto &it : postings) {
+        mem += sizeof(it) + it.second.data.capacity() + 2*sizeof(void*);
+    }
+    return mem;
+}
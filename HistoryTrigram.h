@@ -0,0 +1,88 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2024, John Burnell
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  HistoryTrigram.h
+  Trigram index of the history file for substring searches
+-----------------------------------------------------------------------------*/
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "HistoryFile.h"
+
+
+class HistoryTrigramClass {
+    // For each trigram of lower case characters, the records containing it
+    // as varint deltas of increasing record numbers. Records are numbered in
+    // file order, those in the file's index and then the tail. A query's
+    // trigram lists are intersected and the records found are checked.
+    // The index is saved beside the history file (as .tri) and caught up from
+    // where it stopped, it is rebuilt when the history file is replaced.
+    // Reading, building or a long catch up is done on a thread, from the
+    // saved index, and taken up by a later Update. Only the thread saves.
+public:
+    static const char magic[8];
+    static constexpr uint32_t version = 1;
+    static constexpr size_t headerSize = 48;
+    static constexpr uint64_t maxInline = 1 << 20;  // bytes of records caught up without a thread
+
+protected:
+    struct Posting {
+        std::string data;
+        uint32_t last;
+    };
+    std::unordered_map<uint32_t, Posting> postings;
+    std::vector<uint64_t> offsets;      // record number -> offset in the file
+    uint64_t fileId;
+    uint64_t endOffset;                 // the records before are indexed
+    size_t noSaved;                     // records in the saved index
+    std::string fileName;
+    HistoryFileClass file;
+
+    // building on a thread
+    std::unique_ptr<HistoryTrigramClass> table;
+    std::thread builder;
+    std::atomic<bool> building;
+    std::atomic<bool> stopBuild;
+    bool tableOk;
+
+    void ClearIndex();
+    bool CatchUp(const std::atomic<bool> *stop);
+    void StartBuild();
+    void Take(HistoryTrigramClass &from);
+    void AddRecord(const std::string_view &cmd, const uint64_t offset);
+    bool Read(const std::string &indexName);
+    bool Save(const std::string &indexName);
+    static void Trigrams(const std::string &st, std::vector<uint32_t> &keys);
+    static void Decode(const Posting &post, std::vector<uint32_t> &recs);
+
+public:
+    HistoryTrigramClass();
+    ~HistoryTrigramClass();
+
+    void Clear();
+
+    // Catch up with the history file. The first time, when the file has been
+    // replaced or when there is a lot to catch up with, a thread is started
+    // and false returned until a later Update has taken up what it built
+    bool Update(const std::string &histFile);
+    bool Building() const {return building;}
+
+    // The newest different commands containing query, ignoring case. False
+    // if the query is shorter than a trigram
+    bool Search(const std::string_view &query, const size_t max, std::vector<std::string> &res) const;
+
+    size_t Size() const {return offsets.size();}
+    size_t MemoryUsage() const;
+};
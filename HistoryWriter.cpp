@@ -0,0 +1,197 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2024, John Burnell
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  HistoryWriter.cpp
+  Background thread that writes history records in batches
+-----------------------------------------------------------------------------*/
+
+#include <algorithm>
+#include <cstdlib>
+#include <set>
+
+#include "HistoryWriter.h"
+#include "Utilities.h"
+
+
+namespace {
+    // running writers, drained by an atexit handler so that exit() from a
+    // builtin does not lose queued commands
+    std::mutex writersMutex;
+    std::set<HistoryWriterClass*> writers;
+    bool haveAtExit = false;
+
+    void DrainWriters()
+    {
+        std::set<HistoryWriterClass*> toStop;
+        {
+            std::lock_guard<std::mutex> lck(writersMutex);
+            toStop = writers;
+        }
+        for (auto w : toStop) {
+            w->Stop();
+        }
+    }
+
+    void AddWriter(HistoryWriterClass *w)
+    {
+        std::lock_guard<std::mutex> lck(writersMutex);
+        writers.insert(w);
+        if (!haveAtExit) {
+            std::atexit(DrainWriters);
+            haveAtExit = true;
+        }
+    }
+
+    void RemoveWriter(HistoryWriterClass *w)
+    {
+        std::lock_guard<std::mutex> lck(writersMutex);
+        writers.erase(w);
+    }
+}
+
+
+HistoryWriterClass::HistoryWriterClass()
+{
+    durability = DurFlush;
+    interval = std::chrono::milliseconds(1000);
+    batchSize = 16;
+    noPending = 0;
+    noQueued = 0;
+    noWritten = 0;
+    stop = false;
+    running = false;
+}
+
+
+HistoryWriterClass::~HistoryWriterClass()
+{
+    Stop();
+}
+
+
+HistoryWriterClass::Durability HistoryWriterClass::ParseDurability(const std::string &st)
+{
+    std::string low = Utilities::ToLower(st);
+    if (low == "none") {
+        return DurNone;
+    } else if (low == "fsync" or low == "sync") {
+        return DurSync;
+    }
+    return DurFlush;
+}
+
+
+void HistoryWriterClass::Start(const std::string &file, const Durability dur, const int intervalMS, const int batch)
+{
+    Stop();
+    fileName = file;
+    durability = dur;
+    interval = std::chrono::milliseconds(std::max(intervalMS, 1));
+    batchSize = std::max(batch, 1);
+    stop = false;
+    running = true;
+    thread = std::thread(&HistoryWriterClass::Run, this);
+    AddWriter(this);
+}
+
+
+void HistoryWriterClass::Push(const HistoryFileClass::Record &rec)
+{
+    std::lock_guard<std::mutex> lck(mutex);
+    HistoryFileClass::EncodeRecord(rec, pending);
+    noPending++;
+    if (durability != DurNone or noPending >= batchSize) {
+        cond.notify_one();
+    }
+}
+
+
+void HistoryWriterClass::Flush()
+{
+    std::unique_lock<std::mutex> lck(mutex);
+    if (!running) {
+        return;
+    }
+    // also waits for a batch that is being written
+    uint64_t target = ++noQueued;
+    cond.notify_one();
+    doneCond.wait(lck, [this, target]() {return noWritten >= target or !running;});
+}
+
+
+void HistoryWriterClass::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lck(mutex);
+        if (!thread.joinable()) {
+            return;
+        }
+        stop = true;
+    }
+    cond.notify_one();
+    thread.join();
+    RemoveWriter(this);
+}
+
+
+void HistoryWriterClass::Run()
+{
+    std::unique_lock<std::mutex> lck(mutex);
+    int noTries = 0;                   // of the batch while the file was locked
+    while (true) {
+        cond.wait_for(lck, interval, [this, noTries]() {
+            return stop or noQueued > noWritten or (noTries == 0 and (noPending >= batchSize or
+                   (durability != DurNone and noPending > 0)));
+        });
+
+        // group everything queued so far into one write
+        if (noPending > 0) {
+            std::string buf;
+            buf.swap(pending);
+            size_t noBatch = noPending;
+            noPending = 0;
+            uint64_t queued = noQueued;
+            // when stopping it is written in the end rather than lost
+            bool force = stop and noTries >= maxStopTries;
+            lck.unlock();
+            bool written = WriteBatch(buf, force);
+            lck.lock();
+            if (written) {
+                noTries = 0;
+            } else {
+                noTries++;
+                buf += pending;
+                pending.swap(buf);
+                noPending += noBatch;
+            }
+            noWritten = queued;
+        } else {
+            noWritten = noQueued;
+        }
+        if (stop and noPending == 0) {
+            running = false;
+        }
+        doneCond.notify_all();
+        if (!running) {
+            break;
+        }
+    }
+}
+
+
+bool HistoryWriterClass::WriteBatch(const std::string &buf, const bool force)
+{
+    // a shared lock, as for a single append, keeps out a rewrite of the file,
+    // which would lose the batch, so without it the batch is kept
+    Utilities::FileLock lck(fileName, true);
+    if (!lck.HasLock() and !force) {
+        return false;
+    }
+    if (!HistoryFileClass::AppendData(fileName, buf, durability == DurSync)) {
+        Utilities::LogMessage("Error writing history to " + fileName);
+    }
+    return true;
+}
@@ -0,0 +1,74 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2024, John Burnell
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  HistoryWriter.h
+  Background thread that writes history records in batches
+-----------------------------------------------------------------------------*/
+
+#pragma once
+
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#include "HistoryFile.h"
+
+
+class HistoryWriterClass {
+    // Records are queued by Push and written by a background thread as one
+    // append per batch, when batchSize records are waiting or the interval
+    // has passed. While the file is locked for a rewrite a batch stays queued
+    // and is tried again after the interval. Every writer is drained when the
+    // program exits, including through exit().
+public:
+    enum Durability {
+        DurNone,        // batches are written at the interval or when full
+        DurFlush,       // each command is handed to the OS straight away
+        DurSync         // as DurFlush and each batch is fsync'd
+    };
+
+    static constexpr int maxStopTries = 3;    // of a locked file before a batch is written anyway
+
+protected:
+    std::string fileName;
+    Durability durability;
+    std::chrono::milliseconds interval;
+    size_t batchSize;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::condition_variable doneCond;
+    std::string pending;               // encoded records waiting to be written
+    size_t noPending;
+    uint64_t noQueued;                 // batches queued and written, for Flush
+    uint64_t noWritten;
+    bool stop;
+    bool running;
+    std::thread thread;
+
+    void Run();
+    bool WriteBatch(const std::string &buf, const bool force);
+
+public:
+    HistoryWriterClass();
+    ~HistoryWriterClass();
+
+    void Start(const std::string &fileName, const Durability dur, const int intervalMS, const int batch);
+    bool IsRunning() const {return thread.joinable();}
+
+    void Push(const HistoryFileClass::Record &rec);
+
+    // write anything pending and wait for it, or for the try if the file is
+    // being rewritten
+    void Flush();
+
+    // write anything pending and stop the thread
+    void Stop();
+
+    static Durability ParseDurability(const std::string &st);
+};
@@ -137,7 +137,7 @@ int SetVar(lua_State* L)
 
     LuaInterface **lua = GetLuaInterface(L);
     if (lua) {
-//        (*lua)->shell->SetVariable(var, val);
+        (*lua)->shell->SetVariable(var, val);
     }
 
     return 1;
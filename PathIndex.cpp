@@ -0,0 +1,252 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2024, John Burnell
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  PathIndex.cpp
+  The executables in the PATH folders, for completing command names
+-----------------------------------------------------------------------------*/
+
+#include <algorithm>
+#include <chrono>
+#include <cctype>
+
+#include <filesystem>
+namespace fs = std::filesystem;
+
+#ifndef __WIN32__
+# include <unistd.h>
+#endif
+
+#include "PathIndex.h"
+#include "Utilities.h"
+
+
+PathIndexClass &PathIndexClass::Get()
+{
+    static PathIndexClass instance;
+    return instance;
+}
+
+
+PathIndexClass::PathIndexClass()
+{
+    pending = false;
+    stop = false;
+    lastCheck = 0;
+    ignoreCase = Utilities::IsWindows();
+}
+
+
+PathIndexClass::~PathIndexClass()
+{
+    Stop();
+}
+
+
+void PathIndexClass::Start()
+{
+    Stop();
+    stop = false;
+    thread = std::thread(&PathIndexClass::Run, this);
+    Refresh();
+}
+
+
+void PathIndexClass::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lck(mutex);
+        stop = true;
+    }
+    cond.notify_all();
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+
+void PathIndexClass::Refresh()
+{
+    std::string pathVar = Utilities::GetEnvVar("PATH");
+    if (!thread.joinable()) {
+        std::shared_ptr<const Index> ind = Build(pathVar);
+        std::lock_guard<std::mutex> lck(mutex);
+        index = ind;
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lck(mutex);
+        requested = pathVar;
+        pending = true;
+    }
+    cond.notify_one();
+}
+
+
+void PathIndexClass::Run()
+{
+    std::unique_lock<std::mutex> lck(mutex);
+    while (true) {
+        cond.wait(lck, [this]() {return stop or pending;});
+        if (stop) {
+            return;
+        }
+        // only the newest PATH is built
+        std::string pathVar = requested;
+        pending = false;
+        lck.unlock();
+
+        std::shared_ptr<const Index> ind = Build(pathVar);
+
+        lck.lock();
+        index = ind;
+        doneCond.notify_all();
+    }
+}
+
+
+int64_t PathIndexClass::ModTime(const std::string &folder)
+{
+    std::error_code ec;
+    auto tm = fs::last_write_time(folder, ec);
+    return ec ? -1 : int64_t(tm.time_since_epoch().count());
+}
+
+
+bool PathIndexClass::Less(const std::string &a, const std::string &b) const
+{
+    if (!ignoreCase) {
+        return a < b;
+    }
+    return std::lexicographical_compare(a.begin(), a.end(), b.begin(), b.end(), [](const char x, const char y) {
+        return std::tolower(uint8_t(x)) < std::tolower(uint8_t(y));
+    });
+}
+
+
+bool PathIndexClass::IsExecutable(const std::string &folder, const std::string &name, const bool isDir) const
+{
+    if (isDir) {
+        return false;
+    }
+#ifdef __WIN32__
+    // run by their extension
+    std::string ext = Utilities::ToLower(fs::path(name).extension().string());
+    return std::find(exts.begin(), exts.end(), ext) != exts.end();
+#else
+    std::string path = folder + Utilities::pathSep + name;
+    return access(path.c_str(), X_OK) == 0;
+#endif
+}
+
+
+std::shared_ptr<const PathIndexClass::Index> PathIndexClass::Build(const std::string &pathVar)
+{
+    // a folder is only read again if its time has changed, then the
+    // folders' names are merged
+    std::vector<std::string> paths;
+    Utilities::SplitString(pathVar, Utilities::IsWindows() ? ";" : ":", paths);
+#ifdef __WIN32__
+    std::string extVar = Utilities::GetEnvVar("PATHEXT");
+    exts.clear();
+    Utilities::SplitString(extVar.empty() ? ".COM;.EXE;.BAT;.CMD" : extVar, ";", exts);
+    for (std::string &ext : exts) {
+        ext = Utilities::ToLower(ext);
+    }
+#endif
+    std::vector<Folder> built;
+    for (const std::string &path : paths) {
+        auto dup = std::find_if(built.begin(), built.end(), [&path](const Folder &f) {return f.path == path;});
+        if (dup != built.end()) {
+            continue;
+        }
+        int64_t modTime = ModTime(path);
+        auto old = std::find_if(folders.begin(), folders.end(), [&path](const Folder &f) {return f.path == path;});
+        if (old != folders.end() and old->modTime == modTime) {
+            built.push_back(std::move(*old));
+            continue;
+        }
+        Folder folder{path, modTime, {}};
+        Utilities::ScanFolder(path, [&](const std::string_view &name, const bool isDir) {
+            std::string st(name);
+            if (IsExecutable(path, st, isDir)) {
+                folder.names.push_back(std::move(st));
+            }
+            return true;
+        });
+        std::sort(folder.names.begin(), folder.names.end(), [this](const std::string &a, const std::string &b) {
+            return Less(a, b);
+        });
+        built.push_back(std::move(folder));
+    }
+    folders = std::move(built);
+
+    auto ind = std::make_shared<Index>();
+    ind->pathVar = pathVar;
+    for (const Folder &folder : folders) {
+        ind->folders.push_back({folder.path, folder.modTime});
+        size_t mid = ind->names.size();
+        ind->names.insert(ind->names.end(), folder.names.begin(), folder.names.end());
+        std::inplace_merge(ind->names.begin(), ind->names.begin() + mid, ind->names.end(),
+                           [this](const std::string &a, const std::string &b) {return Less(a, b);});
+    }
+    // a name in more than one folder is only completed once
+    auto last = std::unique(ind->names.begin(), ind->names.end(), [this](const std::string &a, const std::string &b) {
+        return !Less(a, b) and !Less(b, a);
+    });
+    ind->names.erase(last, ind->names.end());
+    return ind;
+}
+
+
+bool PathIndexClass::Find(const std::string &pref, const std::function<bool(const std::string &name)> &found)
+{
+    std::shared_ptr<const Index> ind;
+    {
+        // the first build is started with the shell, so it is rarely waited for
+        std::unique_lock<std::mutex> lck(mutex);
+        if (!index and thread.joinable()) {
+            doneCond.wait_for(lck, std::chrono::milliseconds(checkMS), [this]() {return index != nullptr;});
+        }
+        ind = index;
+    }
+
+    // PATH and the folder times are checked at most every checkMS
+    int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+    if (!ind or now - lastCheck >= checkMS) {
+        lastCheck = now;
+        bool changed = !ind or ind->pathVar != Utilities::GetEnvVar("PATH");
+        for (size_t i = 0; !changed and i < ind->folders.size(); i++) {
+            changed = ModTime(ind->folders[i].first) != ind->folders[i].second;
+        }
+        if (changed) {
+            Refresh();
+            if (!thread.joinable()) {
+                std::lock_guard<std::mutex> lck(mutex);
+                ind = index;
+            }
+        }
+    }
+    if (!ind) {
+        return false;
+    }
+
+    auto first = std::lower_bound(ind->names.begin(), ind->names.end(), pref,
+                                  [this](const std::string &name, const std::string &p) {return Less(name, p);});
+    for (auto it = first; it != ind->names.end() and Utilities::StartsWith(*it, pref, ignoreCase); it++) {
+        if (!found(*it)) {
+            break;
+        }
+    }
+    return true;
+}
+
+
+size_t PathIndexClass::Size()
+{
+    std::lock_guard<std::mutex> lck(mutex);
+    return index ? index->names.size() : 0;
+}
@@ -0,0 +1,87 @@
+/* ----------------------------------------------------------------------------
+  Copyright (c) 2024, John Burnell
+  This is free software; you can redistribute it and/or modify it
+  under the terms of the MIT License. A copy of the license can be
+  found in the "LICENSE" file at the root of this distribution.
+
+  PathIndex.h
+  The executables in the PATH folders, for completing command names
+-----------------------------------------------------------------------------*/
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+class PathIndexClass {
+    // The names of the executables in the PATH folders are kept sorted with
+    // duplicates dropped, so a command name is completed by a binary search.
+    // A background thread builds them at the start and again when PATH or
+    // the modification time of one of its folders changes, reading only the
+    // folders that changed. Until it is done the last ones built are used.
+public:
+    static constexpr int checkMS = 1000;     // between checks of the folder times
+
+protected:
+    struct Folder {
+        std::string path;
+        int64_t modTime;
+        std::vector<std::string> names;
+    };
+    struct Index {
+        std::string pathVar;
+        std::vector<std::pair<std::string, int64_t>> folders;   // and their times
+        std::vector<std::string> names;
+    };
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::condition_variable doneCond;
+    std::shared_ptr<const Index> index;
+    std::string requested;                   // the PATH to build for
+    bool pending;
+    bool stop;
+    std::thread thread;
+    std::vector<Folder> folders;             // only used by the builder
+#ifdef __WIN32__
+    std::vector<std::string> exts;           // PATHEXT, lower case
+#endif
+    int64_t lastCheck;                       // only used by the input thread
+    bool ignoreCase;
+
+    PathIndexClass();
+    ~PathIndexClass();
+
+    void Run();
+    std::shared_ptr<const Index> Build(const std::string &pathVar);
+    bool Less(const std::string &a, const std::string &b) const;
+    bool IsExecutable(const std::string &folder, const std::string &name, const bool isDir) const;
+    static int64_t ModTime(const std::string &folder);
+
+public:
+    PathIndexClass(const PathIndexClass&) = delete;
+    void operator=(const PathIndexClass&) = delete;
+
+    static PathIndexClass &Get();
+
+    // build them on a thread, otherwise Find builds them when needed
+    void Start();
+    void Stop();
+
+    // PATH has changed, rebuild them
+    void Refresh();
+
+    // Call found with the executables starting with pref (ignoring case on
+    // Windows) in name order, until it returns false
+    bool Find(const std::string &pref, const std::function<bool(const std::string &name)> &found);
+
+    size_t Size();
+};
@@ -12,12 +12,15 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <functional>
 #include <filesystem>
 namespace fs = std::filesystem;
 
 #include "Utilities.h"
+#include "HistoryCompact.h"
 
 class LuaInterface;
+class ShellHistoryClass;
 
 class HookData {
 public:
@@ -45,10 +48,13 @@ protected:
   std::map<std::string, std::string> aliases;
   std::string startDir;
 
+  std::map<std::string, std::string> variables;    // settings from SetVar
+
   typedef bool (*CmdFunc)(const std::vector<std::string> &args, ShellDataClass &shell);
   std::map<std::string, CmdFunc> funcs;
 
   LuaInterface *lua;
+  ShellHistoryClass *history;
 
   bool RunCommand(const std::vector<Utilities::CmdToken> &args);
 
@@ -79,5 +85,20 @@ public:
 
   void AddAlias(const std::string &alias, const std::string &cmd);
 
+  // Call found with the builtin commands then the aliases starting with pref,
+  // until it returns false
+  bool FindCommands(const std::string &pref, const std::function<bool(const std::string &name)> &found) const;
+
+  void SetHistory(ShellHistoryClass *his) {history = his;}
+  ShellHistoryClass *GetHistory() {return history;}
+
+  // Controlling variables, set from the configuration
+  void SetVariable(const std::string &var, const std::string &val);
+  std::string GetVariable(const std::string &var, const std::string &def="") const;
+  int GetIntVariable(const std::string &var, const int def) const;
+
+  // HistoryMaxItems and HistoryMaxDays
+  HistoryRetention GetHistoryRetention() const;
+
 
 };
@@ -12,6 +12,7 @@
 #include <fstream>
 #include <iostream>
 #include <thread>
+#include <atomic>
 #include <algorithm>
 #include <filesystem>
 namespace fs = std::filesystem;
@@ -21,8 +22,37 @@ using namespace std::chrono_literals;
 
 #include <algorithm>
 #include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#ifdef __WIN32__
+# include <windows.h>
+# include <io.h>
+// break some of the Utilities routines
+# undef GetCurrentDirectory
+# undef SetCurrentDirectory
+#else
+# include <cerrno>
+# include <fcntl.h>
+# include <poll.h>
+# include <unistd.h>
+# include <sys/file.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+#endif
+#ifdef __linux__
+# include <dirent.h>
+# include <sys/inotify.h>
+# include <sys/syscall.h>
+#endif
 
 #include "Utilities.h"
+#include "DirCache.h"
+#include "PathIndex.h"
+
+// the variables are completed from the environment
+extern char ** environ;
  
 namespace Utilities {
 
@@ -100,6 +130,26 @@ namespace Utilities {
   };
 
 
+  void RunTasks(const std::vector<std::function<void()>> &tasks, const int noThreads)
+  {
+    // tasks are taken in order, so put the longest first
+    std::atomic<size_t> next(0);
+    auto worker = [&tasks, &next]() {
+      for (size_t i = next++; i < tasks.size(); i = next++) {
+        tasks[i]();
+      }
+    };
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < std::min(size_t(std::max(noThreads, 1)), tasks.size()); t++) {
+      threads.emplace_back(worker);
+    }
+    worker();
+    for (auto &t : threads) {
+      t.join();
+    }
+  }
+
+
   void SetupLogging(const bool doLog) 
   {
     LogClass *log = LogClass::GetLog();
@@ -129,6 +179,20 @@ namespace Utilities {
   }
 
 
+  bool HasAVX2()
+  {
+#ifdef AVX2_DISPATCH
+    static const bool has = []() {
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("avx2") != 0;
+    }();
+    return has;
+#else
+    return false;
+#endif
+  }
+
+
   bool SetupConfigFolder()
   {
       fs::path folder(GetConfigFolder());
@@ -165,6 +229,20 @@ namespace Utilities {
     return "";
   }
 
+  // bumped as variables are set, so what is built from them can be rebuilt
+  static uint64_t envGeneration = 0;
+
+  void SetEnvVar(const std::string &var, const std::string &val)
+  {
+    // the value is copied, putenv would keep a pointer to it
+#ifdef __WIN32__
+    _putenv_s(var.c_str(), val.c_str());
+#else
+    setenv(var.c_str(), val.c_str(), 1);
+#endif
+    envGeneration++;
+  }
+
   std::string GetHome()
   {
     std::string pathSep = std::string(1, Utilities::pathSep);
@@ -282,6 +360,300 @@ namespace Utilities {
       return fs::exists(f);
   }
 
+  bool KeyPending()
+  {
+#ifdef __WIN32__
+    // only a key down counts, the console also queues key ups and mouse events
+    HANDLE inp = GetStdHandle(STD_INPUT_HANDLE);
+    INPUT_RECORD recs[32];
+    DWORD noRecs = 0;
+    if (!PeekConsoleInput(inp, recs, 32, &noRecs)) {
+      return false;
+    }
+    for (DWORD i = 0; i < noRecs; i++) {
+      if (recs[i].EventType == KEY_EVENT and recs[i].Event.KeyEvent.bKeyDown) {
+        return true;
+      }
+    }
+    return false;
+#else
+    // a file or pipe is always readable, and nothing is typed into it
+    if (!isatty(STDIN_FILENO)) {
+      return false;
+    }
+    struct pollfd pfd = {STDIN_FILENO, POLLIN, 0};
+    return poll(&pfd, 1, 0) > 0 and (pfd.revents & POLLIN);
+#endif
+  }
+
+  bool ReadFileTail(const std::string &f, const uint64_t offset, std::string &buf, uint64_t &id)
+  {
+    buf.clear();
+    id = 0;
+#ifdef __WIN32__
+    std::ifstream inp(f, std::ios::binary);
+    if (!inp) {
+      return false;
+    }
+    inp.seekg(0, std::ios::end);
+    uint64_t size = inp.tellg();
+    if (size > offset) {
+      buf.resize(size - offset);
+      inp.seekg(offset);
+      inp.read(&buf[0], buf.size());
+      buf.resize(inp.gcount());
+    }
+    return true;
+#else
+    // the id and the data come from the same open file
+    int fd = open(f.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      close(fd);
+      return false;
+    }
+    id = (uint64_t(st.st_dev) << 40) ^ uint64_t(st.st_ino);
+    uint64_t size = st.st_size;
+    if (size > offset) {
+      buf.resize(size - offset);
+      size_t got = 0;
+      while (got < buf.size()) {
+        ssize_t n = pread(fd, &buf[got], buf.size()-got, offset+got);
+        if (n < 0 and errno == EINTR) {
+          continue;
+        }
+        if (n <= 0) {
+          break;
+        }
+        got += n;
+      }
+      buf.resize(got);
+    }
+    close(fd);
+    return true;
+#endif
+  }
+
+
+  uint64_t GetFileId(const std::string &f)
+  {
+#ifdef __WIN32__
+    return 0;
+#else
+    struct stat st;
+    if (stat(f.c_str(), &st) != 0) {
+      return 0;
+    }
+    return (uint64_t(st.st_dev) << 40) ^ uint64_t(st.st_ino);
+#endif
+  }
+
+
+  bool WriteTempFile(const std::string &tmpName, const std::vector<std::string_view> &parts, const bool sync)
+  {
+    std::error_code ec;
+#ifdef __WIN32__
+    FILE *f = std::fopen(tmpName.c_str(), "wb");
+    if (f == nullptr) {
+      return false;
+    }
+    bool ok = true;
+    for (const std::string_view &part : parts) {
+      ok = ok and std::fwrite(part.data(), 1, part.size(), f) == part.size();
+    }
+    ok = ok and std::fflush(f) == 0;
+    if (sync) {
+      ok = ok and FlushFileBuffers(HANDLE(_get_osfhandle(_fileno(f))));
+    }
+    ok = std::fclose(f) == 0 and ok;
+#else
+    int fd = open(tmpName.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd < 0) {
+      return false;
+    }
+    bool ok = true;
+    for (const std::string_view &part : parts) {
+      const char *p = part.data();
+      size_t left = part.size();
+      while (ok and left > 0) {
+        ssize_t n = write(fd, p, left);
+        if (n < 0 and errno == EINTR) {
+          continue;
+        }
+        ok = n > 0;
+        if (ok) {
+          p += n;
+          left -= n;
+        }
+      }
+    }
+    if (sync) {
+      ok = ok and fsync(fd) == 0;
+    }
+    ok = close(fd) == 0 and ok;
+#endif
+    if (!ok) {
+      LogError("Error: cannot write " + tmpName);
+      fs::remove(tmpName, ec);
+    }
+    return ok;
+  }
+
+
+  bool ReplaceFile(const std::string &tmpName, const std::string &fileName, const bool sync)
+  {
+    std::error_code ec;
+#ifdef __WIN32__
+    DWORD flags = MOVEFILE_REPLACE_EXISTING | (sync ? MOVEFILE_WRITE_THROUGH : 0);
+    if (!MoveFileExA(tmpName.c_str(), fileName.c_str(), flags)) {
+      LogError("Error: cannot replace " + fileName);
+      fs::remove(tmpName, ec);
+      return false;
+    }
+#else
+    if (std::rename(tmpName.c_str(), fileName.c_str()) != 0) {
+      LogError("Error: cannot replace " + fileName + ": " + std::strerror(errno));
+      fs::remove(tmpName, ec);
+      return false;
+    }
+    if (sync) {
+      // the rename is only durable once the folder is
+      std::string folder = fs::path(fileName).parent_path().string();
+      int fd = open(folder.empty() ? "." : folder.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+      bool ok = fd >= 0 and fsync(fd) == 0;
+      if (fd >= 0) {
+        close(fd);
+      }
+      if (!ok) {
+        LogError("Error: cannot sync the folder of " + fileName);
+        return false;
+      }
+    }
+#endif
+    return true;
+  }
+
+
+  bool ScanFolder(const std::string &folder,
+                  const std::function<bool(const std::string_view &name, const bool isDir)> &found)
+  {
+#ifdef __linux__
+    // getdents64 returns many entries per call, each a linux_dirent64:
+    // u64 d_ino, s64 d_off, u16 d_reclen, u8 d_type, char d_name[]
+    int fd = open(folder.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+      return false;
+    }
+    std::vector<char> buf(64*1024);
+    bool ok = true;
+    bool more = true;
+    while (more) {
+      long len = syscall(SYS_getdents64, fd, buf.data(), buf.size());
+      if (len < 0 and errno == EINTR) {
+        continue;
+      }
+      if (len <= 0) {
+        ok = len == 0;
+        break;
+      }
+      for (long pos = 0; pos < len and more; ) {
+        const char *ent = buf.data() + pos;
+        uint16_t recLen;
+        std::memcpy(&recLen, ent+16, sizeof(recLen));
+        uint8_t type = ent[18];
+        const char *name = ent+19;
+        pos += recLen;
+        if (name[0] == '.' and (name[1] == '\0' or (name[1] == '.' and name[2] == '\0'))) {
+          continue;
+        }
+        bool isDir = type == DT_DIR;
+        if (type == DT_UNKNOWN or type == DT_LNK) {
+          struct stat st;
+          isDir = fstatat(fd, name, &st, 0) == 0 and S_ISDIR(st.st_mode);
+        }
+        more = found(name, isDir);
+      }
+    }
+    close(fd);
+    return ok;
+#else
+    // the entries carry their type from the listing on Windows
+    std::error_code ec;
+    fs::directory_iterator it(folder, fs::directory_options::skip_permission_denied, ec);
+    for (; !ec and it != fs::directory_iterator(); it.increment(ec)) {
+      std::error_code typeEc;
+      if (!found(it->path().filename().string(), it->is_directory(typeEc))) {
+        break;
+      }
+    }
+    return !ec;
+#endif
+  }
+
+
+  bool ScanFolder(const std::string &folder, std::vector<FolderEntry> &entries)
+  {
+    entries.clear();
+    return ScanFolder(folder, [&entries](const std::string_view &name, const bool isDir) {
+      entries.push_back({std::string(name), isDir});
+      return true;
+    });
+  }
+
+
+  uint32_t Crc32(const char *data, const size_t len, const uint32_t crcIn)
+  {
+    // standard reflected CRC-32 (polynomial 0xEDB88320)
+    struct Table {
+      uint32_t vals[256];
+      Table() {
+        for (uint32_t i = 0; i < 256; i++) {
+          uint32_t c = i;
+          for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+          }
+          vals[i] = c;
+        }
+      }
+    };
+    static const Table table;    // initialised once, safe with threads
+
+    uint32_t crc = ~crcIn;
+    const unsigned char *p = reinterpret_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < len; i++) {
+      crc = table.vals[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+  }
+
+
+  std::string FormatTime(const int64_t t)
+  {
+    std::time_t tt = t;
+    char st[128];
+    std::strftime(st, 128, "%Y-%m-%d %H:%M:%S", std::localtime(&tt));
+    return st;
+  }
+
+
+  int64_t ParseTime(const std::string &st)
+  {
+    // parse the "%Y-%m-%d %H:%M:%S" form used in the text history
+    std::tm tm = {};
+    if (std::sscanf(st.c_str(), "%d-%d-%d %d:%d:%d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+                    &tm.tm_hour, &tm.tm_min, &tm.tm_sec) < 3) {
+      return 0;
+    }
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    tm.tm_isdst = -1;
+    return std::mktime(&tm);
+  }
+
+
   bool SetCurrentDirectory(const std::string &d)
   {
     try {
@@ -387,29 +759,17 @@ int ReplaceAll(std::string &str, const std::string &from, const std::string &to)
 
   bool GetFileMatches(const std::string &line, std::vector<CompletionItem> &matches, int &startPos)
   {
-    // Find matches to last token in line
-    // if token is a blank then return startPos as -1 and match everything
-
-    CmdClass cmds;
-    bool lastBlank = cmds.ParseLine(line, true);
-    // std::vector<std::string> &args = cmds.LastToken();
-
     matches.clear();
+    return GetCompletions(line, [&matches](CompletionItem &&item) {
+      matches.push_back(std::move(item));
+      return true;
+    }, startPos);
+  }
 
-    CmdToken lastTok = cmds.LastToken();
-    std::string fileSt = lastTok.cmd;    // args.back();
-
-    // do this?
-    // if (lastBlank > 0) {
-    //   cmds.PopBack();
-    // }
-
-    startPos = lastTok.startPos;
-    if (lastBlank) {
-      startPos = -1;
-    }
-
-    bool ignoreCase = isWindows;
+  static bool FindFiles(const std::string &word, const bool foldersOnly,
+                        const std::function<bool(CompletionItem &&item)> &found, const std::function<bool()> &stop)
+  {
+    std::string fileSt = word;
     if (isWindows) {
       ReplaceAll(fileSt, "/", std::string(1, Utilities::pathSep));
     }
@@ -477,57 +837,249 @@ int ReplaceAll(std::string &str, const std::string &from, const std::string &to)
 
     std::string quote(1, '"');
   
-    std::string name;
+    // the folder's listing is kept until it changes, so this is a binary search
     size_t searchLen = searchName.length();
-    for(auto const& dir_entry: fs::directory_iterator{searchDir}) {
-        auto ent = dir_entry.path();
-        name = ent.filename().string();
-        if (lastBlank or searchLen == 0 or StartsWith(name, searchName, ignoreCase)) {
-          int prefLen = searchLen;
-
-          // check if a folder
-          if (fs::is_directory(ent) and name.back() != pathSep) {
-            name += pathSep;
-          }
-          if (prepend.length() > 0) {
-            prefLen += replaceLen;
-            name = prepend + name;
-          }
+    // the listing has the entry types, so folders are picked out without a stat
+    auto addEntry = [&](const DirCacheClass::Entry &ent) {
+        if (foldersOnly and !ent.isDir) {
+          return true;
+        }
+        std::string name = ent.name;
+        int prefLen = searchLen;
 
-          
-          bool needQuotes = false;
-          // Add quotes if spaces in name
-          if (name.find(" ") != name.npos) {
-            prefLen = fileSt.size();
-            // std::string prefix = searchDir.string() + pathSep;
-            // name = quote + prefix + name + quote;
-            // name = quote + name + quote;
-            needQuotes = true;
-          }
-          // if (useRelPath) {
-          //   name = relPath.string() + pathSep + name;
-          // }
-          matches.push_back({name, "", needQuotes});
+        // check if a folder
+        if (ent.isDir and name.back() != pathSep) {
+          name += pathSep;
         }
+        if (prepend.length() > 0) {
+          prefLen += replaceLen;
+          name = prepend + name;
+        }
+
+        
+        bool needQuotes = false;
+        // Add quotes if spaces in name
+        if (name.find(" ") != name.npos) {
+          prefLen = fileSt.size();
+          // std::string prefix = searchDir.string() + pathSep;
+          // name = quote + prefix + name + quote;
+          // name = quote + name + quote;
+          needQuotes = true;
+        }
+        // if (useRelPath) {
+        //   name = relPath.string() + pathSep + name;
+        // }
+        return found({name, "", needQuotes});
+    };
+
+    return DirCacheClass::Get().Find(searchDir.string(), searchName, addEntry, stop);
+  }
+
+
+
+  static size_t VariableStart(const std::string &word)
+  {
+    // the $ (or on Windows an opening %) of the variable name ending word
+    size_t pos = word.find_last_of(isWindows ? "$%" : "$");
+    if (pos == word.npos) {
+      return pos;
+    }
+    for (size_t i = pos+1; i < word.size(); i++) {
+      if (!std::isalnum(uint8_t(word[i])) and word[i] != '_') {
+        return word.npos;
+      }
+    }
+    if (word[pos] == '%' and std::count(word.begin(), word.end(), '%') % 2 == 0) {
+      return word.npos;
+    }
+    return pos;
+  }
+
+  static bool FindVariables(const std::string &word, const size_t varPos,
+                            const std::function<bool(CompletionItem &&item)> &found)
+  {
+    // the names are sorted once, and again after a variable is set or the
+    // environment moves, which it does when something else adds one
+    static std::vector<std::string> names;
+    static uint64_t namesGeneration = 0;
+    static char **namesEnv = nullptr;
+    if (namesEnv == nullptr or namesGeneration != envGeneration or namesEnv != environ) {
+      names.clear();
+      for (char **env = environ; *env; env++) {
+        const char *eq = std::strchr(*env, '=');
+        if (eq != nullptr and eq != *env) {
+          names.emplace_back(*env, eq - *env);
+        }
+      }
+      std::sort(names.begin(), names.end());
+      namesGeneration = envGeneration;
+      namesEnv = environ;
     }
 
+    std::string before = word.substr(0, varPos+1);
+    std::string after = word[varPos] == '%' ? "%" : "";
+    std::string pref = word.substr(varPos+1);
+    for (const std::string &name : names) {
+      if (StartsWith(name, pref, isWindows) and !found({before + name + after, "", false})) {
+        break;
+      }
+    }
     return true;
   }
 
+  static bool FindCommands(const std::string &word, const NameSource &commands,
+                           const std::function<bool(CompletionItem &&item)> &found, const std::function<bool()> &stop)
+  {
+    // the shell's own commands and aliases, the executables in PATH, then
+    // the files in the current folder
+    bool more = true;
+    auto addName = [&found, &more](const std::string &name) {
+      more = found({name, "", name.find(' ') != name.npos});
+      return more;
+    };
+    if (commands) {
+      commands(word, addName);
+    }
+    if (more) {
+      PathIndexClass::Get().Find(word, addName);
+    }
+    if (!more) {
+      return true;
+    }
+    return FindFiles(word, false, found, stop);
+  }
+
+  bool GetCompletions(const std::string &line, const std::function<bool(CompletionItem &&item)> &found,
+                      int &startPos, const NameSource &commands, const std::function<bool()> &stop)
+  {
+    // Complete the last word in line, from the source for where it is.
+    // If line ends in a blank return startPos as -1 and match everything
+    CmdClass cmds;
+    bool lastBlank = cmds.ParseLine(line, true);
+    const std::vector<CmdToken> &toks = cmds.GetTokens();
+
+    std::string word;
+    startPos = -1;
+    size_t noBefore = toks.size();
+    if (!lastBlank and !toks.empty()) {
+      word = toks.back().cmd;
+      startPos = toks.back().startPos;
+      noBefore--;
+    }
+    // the words before it, runs of blanks give empty tokens
+    std::vector<std::string> words;
+    for (size_t i = 0; i < noBefore; i++) {
+      if (!toks[i].cmd.empty()) {
+        words.push_back(toks[i].cmd);
+      }
+    }
+    auto isSeparator = [](const std::string &w) {return w == "|" or w == "||" or w == "&&" or w == ";";};
+    bool isCommand = words.empty() or isSeparator(words.back());
+    bool isFirstArg = !words.empty() and (words.size() == 1 or isSeparator(words[words.size()-2]));
+    std::string prev = words.empty() ? "" : words.back();
+
+    size_t varPos = VariableStart(word);
+    if (varPos != word.npos) {
+      return FindVariables(word, varPos, found);
+    }
+    if (isCommand and word.find(pathSep) == word.npos and word.find('/') == word.npos) {
+      return FindCommands(word, commands, found, stop);
+    }
+    if (isFirstArg and (prev == "cd" or prev == "pushd")) {
+      return FindFiles(word, true, found, stop);
+    }
+    // after a redirection, or any other argument
+    return FindFiles(word, false, found, stop);
+  }
+
+
+  FileCompleter::FileCompleter()
+  {
+    maxItems = 1000;
+    budgetMS = 50;
+    noShown = 0;
+    more = false;
+  }
+
+  void FileCompleter::SetLimits(const size_t maxIt, const int budget)
+  {
+    maxItems = std::max(size_t(2), maxIt);
+    budgetMS = budget;
+  }
+
+  void FileCompleter::SetCommands(const NameSource &src)
+  {
+    commands = src;
+  }
 
   bool FileCompleter::FindItems(const std::string &inp, Crossline &cLine, const int pos)
   {
     // complete file name
     try {
-      std::vector<CompletionItem> comp;
       int startPos;  // the start of the word being matched
       // just pass the portion up to pos
       std::string stIn = inp.substr(0, pos);
-      GetFileMatches(stIn, comp, startPos);
+
+      // Tab again carries on from the last match shown, which is shown again
+      // so there are always two or more and none is put in the line
+      size_t skip = 0;
+      if (more and stIn == lastInput) {
+        skip = noShown - 1;
+      } else {
+        noShown = 0;
+      }
+      lastInput = stIn;
+      more = false;
+
+      // The key and the time are checked every 64 entries passed to found,
+      // shown or skipped, and by the sources as they read and walk folders,
+      // however few match. Running out of time with some found shows them
+      auto t0 = std::chrono::steady_clock::now();
+      bool keyPressed = false;
+      bool outOfTime = false;
+      std::vector<CompletionItem> comp;
+      size_t noMatched = 0;
+      auto stop = [&]() {
+        keyPressed = keyPressed or KeyPending();
+        if (!keyPressed and !comp.empty() and
+            std::chrono::steady_clock::now() - t0 > std::chrono::milliseconds(budgetMS)) {
+          outOfTime = true;
+        }
+        return keyPressed or outOfTime;
+      };
+      bool res = GetCompletions(stIn, [&](CompletionItem &&item) {
+        if (++noMatched % 64 == 0 and stop()) {
+          return false;
+        }
+        if (noMatched <= skip) {
+          return true;
+        }
+        if (comp.size() >= maxItems) {
+          more = true;
+          return false;
+        }
+        comp.push_back(std::move(item));
+        return true;
+      }, startPos, commands, stop);
       if (startPos < 0) {
         startPos = pos;
       }
       Setup(startPos, pos);
+      if (keyPressed) {
+        // the key is handled rather than the matches shown
+        more = false;
+        lastInput.clear();
+        return false;
+      }
+      if (outOfTime) {
+        more = true;
+      } else if (!res) {
+        more = false;
+        lastInput.clear();
+        LogError("Error: cannot read the folder to complete " + stIn);
+        return false;
+      }
+      noShown = skip + comp.size();
 
       LogMessage("Completions for " + inp);
       for (size_t i = 0; i < comp.size(); i++) {
@@ -538,7 +1090,13 @@ int ReplaceAll(std::string &str, const std::string &from, const std::string &to)
         Utilities::LogMessage(msg.str());
         Add(cmp, "", cmd.NeedQuotes());
       }
+      if (more) {
+        LogMessage("More completions after " + std::to_string(noShown));
+      }
     } catch (std::exception &e) {
+      more = false;
+      lastInput.clear();
+      LogError(std::string("Error completing ") + inp + ": " + e.what());
     }
 
     return Size() > 0;
@@ -612,38 +1170,81 @@ int ReplaceAll(std::string &str, const std::string &from, const std::string &to)
   }
 
 
-  FileLock::FileLock(const std::string &fullName)
+  FileLock::FileLock(const std::string &fullName, const bool shared, const int waitMS)
   {
-    fs::path fullPath(fullName);
-    std::string fileName = fullPath.filename().string();
-
-    fs::path configFolder(Utilities::GetConfigFolder());
-    fs::path lckFilePath = configFolder / (fileName + ".lck");
-    lckFile = lckFilePath.string();
+    // Lock a file next to fullName with the kernel's advisory locks. The lock
+    // is released when the file is closed, so a crashed shell never leaves a
+    // stale lock, and the file itself is never removed. The lock is tried
+    // without blocking until waitMS has passed, so a shell stopped while
+    // holding it (or a hung network file system) cannot hang this one
+    lckFile = fullName + ".lck";
+    hasLock = false;
 
-    hasLock = true;
-    std::chrono::high_resolution_clock clock;
-    constexpr auto t20{20ms};
-    auto t1 = clock.now();
-    while (fs::exists(lckFile)) {
-        std::this_thread::sleep_for(t20);
-        std::chrono::duration<double> timeSpan 
-            = std::chrono::duration_cast<std::chrono::duration<double>>(clock.now() - t1);
-        if (timeSpan.count() > 1.0) {
-            std::cout << "Waiting too long for file lock\n";
-            hasLock = false;
-            return;
-        }
+#ifdef __WIN32__
+    handle = CreateFileA(lckFile.c_str(), GENERIC_READ | GENERIC_WRITE, 
+                         FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                         NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (handle == INVALID_HANDLE_VALUE) {
+      LogMessage("Cannot open lock file " + lckFile);
+      return;
+    }
+    DWORD flags = LOCKFILE_FAIL_IMMEDIATELY | (shared ? 0 : LOCKFILE_EXCLUSIVE_LOCK);
+    auto tryLock = [this, flags]() {
+      OVERLAPPED ov = {};
+      return LockFileEx(handle, flags, 0, 1, 0, &ov) != 0;
+    };
+#else
+    fd = open(lckFile.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+      LogMessage("Cannot open lock file " + lckFile);
+      return;
+    }
+    int op = (shared ? LOCK_SH : LOCK_EX) | LOCK_NB;
+    bool failed = false;
+    auto tryLock = [this, op, &failed]() {
+      int res;
+      while ((res = flock(fd, op)) != 0 and errno == EINTR) {
+      }
+      failed = res != 0 and errno != EWOULDBLOCK;
+      return res == 0;
+    };
+#endif
+    // back off from 1 ms to 32 ms between tries
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(std::max(waitMS, 0));
+    int sleepMS = 1;
+    while (!(hasLock = tryLock())) {
+#ifndef __WIN32__
+      if (failed) {
+        LogMessage("Cannot lock " + lckFile + ": " + std::strerror(errno));
+        return;
+      }
+#endif
+      auto now = std::chrono::steady_clock::now();
+      if (now >= deadline) {
+        LogMessage("Timed out after " + std::to_string(waitMS) + " ms waiting for " + lckFile);
+        return;
+      }
+      auto pause = std::min<std::chrono::steady_clock::duration>(std::chrono::milliseconds(sleepMS), deadline - now);
+      std::this_thread::sleep_for(pause);
+      sleepMS = std::min(2*sleepMS, 32);
     }
-
-    std::ofstream lck(lckFile);
-    lck << "Locked\n";
-    lck.close();
   }
 
   FileLock::~FileLock()
   {
-    fs::remove(lckFile);
+#ifdef __WIN32__
+    if (handle != INVALID_HANDLE_VALUE) {
+      if (hasLock) {
+        OVERLAPPED ov = {};
+        UnlockFileEx(handle, 0, 1, 0, &ov);
+      }
+      CloseHandle(handle);
+    }
+#else
+    if (fd >= 0) {
+      close(fd);
+    }
+#endif
   }
 
   bool FileLock::HasLock() const
@@ -652,6 +1253,199 @@ int ReplaceAll(std::string &str, const std::string &from, const std::string &to)
   }
 
 
+  FileWatch::FileWatch()
+  {
+    changed = false;
+#ifdef __linux__
+    fd = -1;
+#else
+    lastCheck = 0;
+    lastSize = 0;
+    lastTime = 0;
+#endif
+  }
+
+  FileWatch::~FileWatch()
+  {
+    Close();
+  }
+
+  bool FileWatch::Open(const std::string &f)
+  {
+    Close();
+    fileName = f;
+    fs::path path(f);
+    name = path.filename().string();
+    changed = false;
+#ifdef __linux__
+    // watch the folder, so a rename over the file is seen as well
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) {
+      return false;
+    }
+    std::string dir = path.has_parent_path() ? path.parent_path().string() : ".";
+    uint32_t mask = IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE;
+    if (inotify_add_watch(fd, dir.c_str(), mask) < 0) {
+      close(fd);
+      fd = -1;
+      return false;
+    }
+    return true;
+#else
+    std::error_code ec;
+    lastSize = fs::file_size(f, ec);
+    lastTime = fs::last_write_time(f, ec).time_since_epoch().count();
+    return !ec;
+#endif
+  }
+
+  void FileWatch::Close()
+  {
+#ifdef __linux__
+    if (fd >= 0) {
+      close(fd);
+    }
+    fd = -1;
+#endif
+  }
+
+  bool FileWatch::Changed()
+  {
+#ifdef __linux__
+    if (fd < 0) {
+      return false;
+    }
+    // drain the queued events, a read never blocks
+    alignas(struct inotify_event) char buf[4096];
+    ssize_t len;
+    while ((len = read(fd, buf, sizeof(buf))) > 0) {
+      for (char *p = buf; p < buf + len; ) {
+        struct inotify_event *ev = reinterpret_cast<struct inotify_event*>(p);
+        if (ev->len > 0 and name == ev->name) {
+          changed = true;
+        }
+        if (ev->mask & IN_Q_OVERFLOW) {
+          changed = true;
+        }
+        p += sizeof(struct inotify_event) + ev->len;
+      }
+    }
+#else
+    int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+    if (now - lastCheck >= pollMS) {
+      lastCheck = now;
+      std::error_code ec;
+      uint64_t size = fs::file_size(fileName, ec);
+      int64_t tm = fs::last_write_time(fileName, ec).time_since_epoch().count();
+      if (!ec and (size != lastSize or tm != lastTime)) {
+        lastSize = size;
+        lastTime = tm;
+        changed = true;
+      }
+    }
+#endif
+    bool res = changed;
+    changed = false;
+    return res;
+  }
+
+
+  MappedFile::MappedFile()
+  {
+    data = nullptr;
+    size = 0;
+  }
+
+  MappedFile::~MappedFile()
+  {
+    Close();
+  }
+
+  void MappedFile::Swap(MappedFile &other)
+  {
+    std::swap(data, other.data);
+    std::swap(size, other.size);
+#ifdef __WIN32__
+    // the data is in the buffer, which may move
+    buffer.swap(other.buffer);
+    data = data != nullptr ? buffer.data() : nullptr;
+    other.data = other.data != nullptr ? other.buffer.data() : nullptr;
+#endif
+  }
+
+#ifdef __WIN32__
+  bool MappedFile::Open(const std::string &fileName)
+  {
+    // no mmap, so read the file into a buffer
+    Close();
+    std::ifstream inp(fileName, std::ios::binary);
+    if (!inp) {
+      return false;
+    }
+    buffer.assign(std::istreambuf_iterator<char>(inp), std::istreambuf_iterator<char>());
+    data = buffer.data();
+    size = buffer.size();
+    return true;
+  }
+
+  void MappedFile::Close()
+  {
+    buffer.clear();
+    buffer.shrink_to_fit();
+    data = nullptr;
+    size = 0;
+  }
+
+  void MappedFile::WillNeed(const size_t offset, const size_t len) const
+  {
+    // already in memory
+  }
+#else
+  bool MappedFile::Open(const std::string &fileName)
+  {
+    Close();
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 or st.st_size == 0) {
+      close(fd);
+      return false;
+    }
+    void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+      return false;
+    }
+    data = static_cast<const char*>(p);
+    size = st.st_size;
+    return true;
+  }
+
+  void MappedFile::Close()
+  {
+    if (data != nullptr) {
+      munmap(const_cast<char*>(data), size);
+    }
+    data = nullptr;
+    size = 0;
+  }
+
+  void MappedFile::WillNeed(const size_t offset, const size_t len) const
+  {
+    if (data == nullptr or offset >= size) {
+      return;
+    }
+    // madvise needs a page aligned start
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t start = offset - offset % page;
+    madvise(const_cast<char*>(data) + start, std::min(offset+len, size) - start, MADV_WILLNEED);
+  }
+#endif
+
+
   CmdToken::CmdToken(const std::string tok, const int st, const int qp) {
       cmd = tok;
       startPos = st;
@@ -834,11 +1628,11 @@ int main(int argc, char const *argv[])
     return 0;
   }
   std::string line = argv[1];
-  std::vector<std::string> toks;
+  Utilities::CmdClass cmds;
 
   std::cout << "Processing " << line << "\n";
 
-  Utilities::ParseLine(line, toks, true);
+  cmds.ParseLine(line, true);
 
   return 0;
 }
@@ -10,12 +10,22 @@
 
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <memory>
+#include <functional>
 
 #include <crossline.h>
 
+// x86 kernels for AVX2 are built with the target attribute, without -mavx2,
+// and used when HasAVX2 says the CPU has it
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define AVX2_DISPATCH 1
+#define AVX2_TARGET __attribute__((target("avx2")))
+#endif
+
 namespace Utilities {
 
 #ifdef __WIN32__
@@ -24,20 +34,49 @@ namespace Utilities {
   static const char pathSep = '/';
 #endif
 
+  // finds the names starting with pref, calling found with each in name
+  // order until it returns false
+  typedef std::function<bool(const std::string &pref,
+                             const std::function<bool(const std::string &name)> &found)> NameSource;
+
   class FileCompleter : public CompleterClass {
+      // Matches are produced in name order and added until maxItems have
+      // been, budgetMS has passed with some found, or a key is pressed, which
+      // drops them. Tab again on the same input adds the ones after them. A
+      // folder that cannot be read is logged as an error
+  protected:
+      size_t maxItems;
+      int budgetMS;
+      std::string lastInput;      // the input last completed
+      size_t noShown;             // the matches of it added so far
+      bool more;                  // and whether there were more
+      NameSource commands;        // the shell's commands and aliases
   public:
+      FileCompleter();
+
+      void SetLimits(const size_t maxItems, const int budgetMS);
+      void SetCommands(const NameSource &src);
+
       // Complete the string in inp, return match in completions and the prefix that was matched in pref, called when the user presses tab
       virtual bool FindItems(const std::string &inp, Crossline &cLine, const int pos);
   };
 
 
   bool IsWindows();
+  bool HasAVX2();
   
   void SplitString(const std::string &st, const std::string &sep, std::vector<std::string> &res);
   bool StartsWith(const std::string &mainStr, const std::string &startIn, const bool ignoreCase=false);
 
   bool StartsWith(const std::string &mainStr, const std::string &start, const bool ignoreCase);
   bool GetFileMatches(const std::string &line, std::vector<CompletionItem> &matches, int &startPos);
+  // Call found with each completion of the last word of line until it returns
+  // false. By where the word is they are: a variable after $ (or %), a command
+  // name from commands, PATH then the current folder, a folder after cd or
+  // pushd, or else a file. stop is checked while a folder is first read and
+  // ends it if it returns true
+  bool GetCompletions(const std::string &line, const std::function<bool(CompletionItem &&item)> &found,
+                      int &startPos, const NameSource &commands=nullptr, const std::function<bool()> &stop=nullptr);
 
   std::string AbbrevPath(const std::string &path, const int maxLen);
 
@@ -51,6 +90,8 @@ namespace Utilities {
   std::string ToLower(const std::string &st);
 
   std::string GetEnvVar(const std::string &var);
+  // set var for the shell and the commands it runs
+  void SetEnvVar(const std::string &var, const std::string &val);
   std::string GetHome();
 
   bool SetupConfigFolder();
@@ -59,6 +100,43 @@ namespace Utilities {
 
   bool FileExists(const std::string &f);
 
+  // true if a key is waiting to be read from the console
+  bool KeyPending();
+
+  // Read f from offset to the end into buf. id identifies the file (0 if not
+  // known) so a file replaced by a rename can be detected
+  bool ReadFileTail(const std::string &f, const uint64_t offset, std::string &buf, uint64_t &id);
+  uint64_t GetFileId(const std::string &f);
+
+  // Write parts to tmpName, synced to the disk if sync. On any failure the
+  // file is removed and false returned
+  bool WriteTempFile(const std::string &tmpName, const std::vector<std::string_view> &parts, const bool sync);
+  // Rename tmpName over fileName. If sync the folder is synced too, so the
+  // rename survives a crash. On failure tmpName is removed
+  bool ReplaceFile(const std::string &tmpName, const std::string &fileName, const bool sync);
+
+  struct FolderEntry {
+    std::string name;
+    bool isDir;
+  };
+
+  // Call found with each entry of folder but . and .., until it returns false.
+  // isDir follows links. On Linux the type comes from the listing, so an entry
+  // is only stat'ed if it is a link or the file system does not give its type.
+  // False if the folder cannot be read
+  bool ScanFolder(const std::string &folder,
+                  const std::function<bool(const std::string_view &name, const bool isDir)> &found);
+  bool ScanFolder(const std::string &folder, std::vector<FolderEntry> &entries);
+
+  uint32_t Crc32(const char *data, const size_t len, const uint32_t crc=0);
+
+  // Run the tasks on up to noThreads threads, including the caller, and wait for them
+  void RunTasks(const std::vector<std::function<void()>> &tasks, const int noThreads);
+
+  // times are stored as seconds since the epoch and shown in local time
+  std::string FormatTime(const int64_t t);
+  int64_t ParseTime(const std::string &st);
+
   void SetupLogging(const bool doLog);
   void LogMessage(const std::string &msg);
   void LogError(const std::string &msg);
@@ -116,13 +194,82 @@ namespace Utilities {
 
 
   class FileLock {
+    // advisory lock on fileName.lck, held until destroyed. Appenders take a
+    // shared lock, anything that replaces the file takes an exclusive lock.
+    // Waits at most waitMS for it, check HasLock
+  public:
+    static constexpr int defaultWaitMS = 2000;
   protected:
     bool hasLock;
     std::string lckFile;
+#ifdef __WIN32__
+    void *handle;
+#else
+    int fd;
+#endif
   public:
-    FileLock(const std::string &fileName);
+    FileLock(const std::string &fileName, const bool shared=false, const int waitMS=defaultWaitMS);
     ~FileLock();
+    FileLock(const FileLock&) = delete;
+    void operator=(const FileLock&) = delete;
     bool HasLock() const;
   };
 
+
+  class FileWatch {
+    // Reports changes to a file, including it being replaced by a rename.
+    // Uses inotify on Linux, elsewhere compares the size and time at most
+    // every pollMS.
+  protected:
+    std::string fileName;
+    std::string name;             // file name without the folder
+    bool changed;
+#ifdef __linux__
+    int fd;
+#else
+    int64_t lastCheck;
+    uint64_t lastSize;
+    int64_t lastTime;
+#endif
+  public:
+    static constexpr int pollMS = 200;
+
+    FileWatch();
+    ~FileWatch();
+    FileWatch(const FileWatch&) = delete;
+    void operator=(const FileWatch&) = delete;
+
+    bool Open(const std::string &fileName);
+    void Close();
+
+    // true if the file may have changed since the last call
+    bool Changed();
+  };
+
+
+  class MappedFile {
+    // read only view of a whole file, uses mmap where available
+  protected:
+    const char *data;
+    size_t size;
+#ifdef __WIN32__
+    std::string buffer;
+#endif
+  public:
+    MappedFile();
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    void operator=(const MappedFile&) = delete;
+
+    bool Open(const std::string &fileName);
+    void Close();
+    void Swap(MappedFile &other);
+
+    const char *Data() const {return data;}
+    size_t Size() const {return size;}
+
+    // hint that [offset, offset+len) will be read soon
+    void WillNeed(const size_t offset, const size_t len) const;
+  };
+
 }
\ No newline at end of file